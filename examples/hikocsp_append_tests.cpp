@@ -21,9 +21,7 @@ out += "x=";
 #line 15
 out += std::format(("{}"), (x + a));
 #line 15
-out += "\x24";
-#line 15
-out += ", ";
+out += "\x24, ";
 #line 15
 
 #line 16
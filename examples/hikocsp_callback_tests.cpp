@@ -21,9 +21,7 @@ sink("x=");
 #line 14
 sink(std::format(("{}"), (x + a)));
 #line 14
-sink("\x24");
-#line 14
-sink(", ");
+sink("\x24, ");
 #line 14
 
 #line 15
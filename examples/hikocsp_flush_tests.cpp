@@ -0,0 +1,54 @@
+#line 1 "examples/hikocsp_flush_tests.cpp.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include <gtest/gtest.h>
+#include <format>
+#include <string>
+#include <vector>
+
+[[nodiscard]] std::vector<std::string> flush_page(std::string title, std::vector<int> list) noexcept
+{
+    auto chunks = std::vector<std::string>{};
+    auto flush = [&](std::string const& out) {
+        chunks.push_back(out);
+    };
+
+    auto out = std::string{};
+#line 18
+out += "<html><head><title>";
+#line 18
+out += std::format(("{}"), (title));
+#line 18
+out += "</title></head>\n";
+#line 19
+flush(out);
+out.clear();
+#line 19
+out += "<body>\n";
+#line 20
+for (auto x: list) {
+#line 21
+out += std::format(("{}"), (x));
+#line 21
+out += "\n";
+#line 22
+}
+#line 23
+out += "</body></html>\n";
+#line 24
+
+    flush(out);
+    return chunks;
+}
+
+TEST(flush_example, flush_page)
+{
+    auto result = flush_page("foo", std::vector{1, 2, 3});
+
+    ASSERT_EQ(result.size(), 2);
+    ASSERT_EQ(result[0], "<html><head><title>foo</title></head>\n");
+    ASSERT_EQ(result[1], "<body>\n1\n2\n3\n</body></html>\n");
+}
@@ -0,0 +1,81 @@
+#line 1 "examples/hikocsp_fragment_cache_tests.cpp.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include "hikocsp/fragment_cache.hpp"
+#include <gtest/gtest.h>
+#include <format>
+
+struct product {
+    int id;
+    std::string name;
+};
+
+inline int num_rendered = 0;
+
+[[nodiscard]] std::string render(product const& p) noexcept
+{
+    ++num_rendered;
+    return p.name;
+}
+
+[[nodiscard]] csp::generator<std::string> fragment_cache_page(csp::fragment_cache& fragments, std::vector<product> list) noexcept
+{
+#line 24
+co_yield "<ul>\n";
+#line 25
+for (auto const& p : list) {
+#line 26
+{
+auto const csp_fragment_1_key = std::format("{}\x1f{}", "examples/hikocsp_fragment_cache_tests.cpp.csp:26", (p.id));
+auto csp_fragment_1 = fragments.get(csp_fragment_1_key);
+if (not csp_fragment_1) {
+auto csp_fragment_1_text = std::string{};
+#line 26
+csp_fragment_1_text += "<li>";
+#line 26
+csp_fragment_1_text += std::format(("{}"), (render(p)));
+#line 26
+csp_fragment_1_text += "</li>\n";
+csp_fragment_1 = fragments.put(csp_fragment_1_key, std::move(csp_fragment_1_text));
+}
+co_yield *csp_fragment_1;
+}
+#line 27
+
+#line 28
+}
+#line 29
+co_yield "</ul>\n";
+#line 30
+}
+
+TEST(fragment_cache_example, fragment_cache_page)
+{
+    auto fragments = csp::fragment_cache{};
+    auto const list = std::vector{product{1, "foo"}, product{2, "bar"}, product{1, "foo"}};
+
+    auto const expected = std::string{
+        "<ul>\n"
+        "<li>foo</li>\n"
+        "<li>bar</li>\n"
+        "<li>foo</li>\n"
+        "</ul>\n"
+    };
+
+    for (auto i = 0; i != 2; ++i) {
+        auto result = std::string{};
+        for (auto const &s: fragment_cache_page(fragments, list)) {
+            result += s;
+        }
+        ASSERT_EQ(result, expected);
+    }
+
+    // Each product is rendered once.
+    ASSERT_EQ(num_rendered, 2);
+    ASSERT_EQ(fragments.statistics().hits, 4);
+    ASSERT_EQ(fragments.statistics().misses, 2);
+}
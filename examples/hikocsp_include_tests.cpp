@@ -0,0 +1,55 @@
+#line 1 "examples/hikocsp_include_tests.cpp.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include <gtest/gtest.h>
+#include <format>
+
+[[nodiscard]] csp::generator<std::string> include_page(std::vector<int> list) noexcept
+{
+#line 10
+co_yield "\n"
+  "<table>\n";
+#line 12
+for (auto x: list) {
+#line 1 "examples/hikocsp_include_row.csp"
+#line 1
+co_yield "<tr><td>";
+#line 1
+co_yield std::format(("{}"), (x));
+#line 1
+co_yield "</td><td>";
+#line 1
+co_yield std::format(("{}"), (x * x));
+#line 1
+co_yield "</td></tr>\n";
+#line 13 "examples/hikocsp_include_tests.cpp.csp"
+#line 13
+
+#line 14
+}
+#line 15
+co_yield "</table>\n";
+#line 16
+}
+
+TEST(include_example, include_page)
+{
+    auto result = std::string{};
+    for (auto const &s: include_page(std::vector{1, 2, 3})) {
+        result += s;
+    }
+
+    auto const expected = std::string{
+        "\n<table>\n"
+        "<tr><td>1</td><td>1</td></tr>\n"
+        "<tr><td>2</td><td>4</td></tr>\n"
+        "<tr><td>3</td><td>9</td></tr>\n"
+        "</table>\n"
+    };
+
+    ASSERT_EQ(result, expected);
+}
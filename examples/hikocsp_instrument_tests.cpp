@@ -0,0 +1,48 @@
+#line 1 "examples/hikocsp_instrument_tests.cpp.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include "hikocsp/profiler.hpp"
+#include <gtest/gtest.h>
+#include <format>
+#include <algorithm>
+
+[[nodiscard]] csp::generator<std::string> instrument_page(std::vector<int> list) noexcept
+{
+#line 12
+co_yield ([&] { static auto csp_site = csp::profile_site{"examples/hikocsp_instrument_tests.cpp.csp", 12, "text"}; return csp_site.count("<ul>\n"); })();
+#line 13
+for (auto x: list) {
+#line 14
+co_yield ([&] { static auto csp_site = csp::profile_site{"examples/hikocsp_instrument_tests.cpp.csp", 14, "text"}; return csp_site.count("<li>"); })();
+#line 14
+co_yield ([&] { static auto csp_site = csp::profile_site{"examples/hikocsp_instrument_tests.cpp.csp", 14, "placeholder"}; return csp_site.measure([&] { return std::format(("{}"), (x)); }); })();
+#line 14
+co_yield ([&] { static auto csp_site = csp::profile_site{"examples/hikocsp_instrument_tests.cpp.csp", 14, "text"}; return csp_site.count("</li>\n"); })();
+#line 15
+}
+#line 16
+co_yield ([&] { static auto csp_site = csp::profile_site{"examples/hikocsp_instrument_tests.cpp.csp", 16, "text"}; return csp_site.count("</ul>\n"); })();
+#line 17
+}
+
+TEST(instrument_example, instrument_page)
+{
+    auto result = std::string{};
+    for (auto const &s: instrument_page(std::vector{1, 22, 333})) {
+        result += s;
+    }
+    ASSERT_EQ(result, "<ul>\n<li>1</li>\n<li>22</li>\n<li>333</li>\n</ul>\n");
+
+    auto const report = csp::profile_report();
+    auto const placeholder = std::find_if(report.begin(), report.end(), [](auto const& entry) {
+        return entry.path.ends_with("hikocsp_instrument_tests.cpp.csp") and entry.kind == "placeholder";
+    });
+    ASSERT_NE(placeholder, report.end());
+    ASSERT_EQ(placeholder->line_nr, 14);
+    ASSERT_EQ(placeholder->calls, 3);
+    ASSERT_EQ(placeholder->bytes, 6);
+}
@@ -0,0 +1,136 @@
+#line 1 "examples/hikocsp_interpreter_tests.cpp.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include "hikocsp/csp_interpreter.hpp"
+#include <gtest/gtest.h>
+#include <format>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+[[nodiscard]] static std::string html(std::string str)
+{
+    auto r = std::string{};
+    for (auto c : str) {
+        switch (c) {
+        case '<': r += "&lt;"; break;
+        case '>': r += "&gt;"; break;
+        case '&': r += "&amp;"; break;
+        default: r += c;
+        }
+    }
+    return r;
+}
+
+[[nodiscard]] csp::generator<std::string>
+interpreter_page(std::string title, bool empty, std::vector<int> rows, double price, std::string name) noexcept
+{
+#line 1 "examples/hikocsp_interpreter_page.csp"
+#line 1
+co_yield "<h1>";
+#line 1
+co_yield (html)(std::format(("{}"), (title)));
+#line 1
+co_yield "</h1>\n";
+#line 2
+if (empty) {
+#line 3
+co_yield "<p>No items.</p>\n";
+#line 4
+} else {
+#line 5
+co_yield "<table>\n";
+#line 6
+for (auto const &row : rows) {
+#line 7
+co_yield "<tr><td>";
+#line 7
+co_yield std::format(("{:>3}"), ( row));
+#line 7
+co_yield "</td><td>";
+#line 7
+co_yield std::format(("{:x}"), ( row));
+#line 7
+co_yield "</td></tr>\n";
+#line 8
+}
+#line 9
+co_yield "</table>\n";
+#line 10
+}
+#line 11
+co_yield "\x24";
+#line 11
+co_yield std::format(("{}"), (price));
+#line 11
+co_yield " for ";
+#line 11
+co_yield (html)(std::format(("{}"), (name)));
+#line 11
+co_yield ".\n";
+#line 30 "examples/hikocsp_interpreter_tests.cpp.csp"
+#line 30
+
+}
+
+[[nodiscard]] static std::string translated(std::string title, std::vector<int> rows, double price, std::string name)
+{
+    auto r = std::string{};
+    for (auto const &s: interpreter_page(title, rows.empty(), rows, price, name)) {
+        r += s;
+    }
+    return r;
+}
+
+[[nodiscard]] static std::string interpreted(std::string title, std::vector<int> rows, double price, std::string name)
+{
+    // The template is read at run-time from next to this file.
+    auto const path = std::filesystem::path{__FILE__}.parent_path() / "hikocsp_interpreter_page.csp";
+    auto f = std::ifstream(path);
+    auto const text = std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    auto filters = csp::csp_filters{};
+    filters["html"] = html;
+
+    auto variables = csp::csp_variables{};
+    variables["title"] = title;
+    variables["empty"] = rows.empty();
+    variables["rows"] = rows;
+    variables["price"] = price;
+    variables["name"] = name;
+
+    auto const program = csp::compile_csp(text, path, filters);
+    return program.render(variables);
+}
+
+TEST(interpreter_example, interpreter_page)
+{
+    auto const expected = std::string{
+        "<h1>Fish &amp; Chips</h1>\n"
+        "<table>\n"
+        "<tr><td>  1</td><td>1</td></tr>\n"
+        "<tr><td> 10</td><td>a</td></tr>\n"
+        "<tr><td>255</td><td>ff</td></tr>\n"
+        "</table>\n"
+        "$4.5 for &lt;fish&gt;.\n"
+    };
+
+    ASSERT_EQ(translated("Fish & Chips", {1, 10, 255}, 4.5, "<fish>"), expected);
+    ASSERT_EQ(interpreted("Fish & Chips", {1, 10, 255}, 4.5, "<fish>"), expected);
+}
+
+TEST(interpreter_example, interpreter_page_empty)
+{
+    auto const expected = std::string{
+        "<h1></h1>\n"
+        "<p>No items.</p>\n"
+        "$0.1 for .\n"
+    };
+
+    ASSERT_EQ(translated("", {}, 0.1, ""), expected);
+    ASSERT_EQ(interpreted("", {}, 0.1, ""), expected);
+}
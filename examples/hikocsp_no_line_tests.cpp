@@ -13,8 +13,7 @@ co_yield "\n"
 for (auto x: list) {
 co_yield "x=";
 co_yield std::format(("{}"), (x + a));
-co_yield "\x24";
-co_yield ", ";
+co_yield "\x24, ";
 
 }
 co_yield "bar\n";
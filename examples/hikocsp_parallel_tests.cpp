@@ -0,0 +1,78 @@
+#line 1 "examples/hikocsp_parallel_tests.cpp.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include "hikocsp/parallel_sections.hpp"
+#include <gtest/gtest.h>
+#include <format>
+#include <thread>
+
+[[nodiscard]] csp::generator<std::string> parallel_page(std::vector<int> list) noexcept
+{
+    auto threads = std::vector<std::jthread>{};
+    auto executor = [&threads](std::function<void()> task) {
+        threads.emplace_back(std::move(task));
+    };
+#line 17
+co_yield "<table>\n";
+#line 18
+{
+auto&& csp_parallel_1_executor = (executor);
+auto csp_parallel_1 = csp::parallel_sections{2};
+csp_parallel_1.run(csp_parallel_1_executor, 0, [&](std::string& csp_parallel_1_text) {
+#line 18
+for (auto x: list) {
+#line 19
+csp_parallel_1_text += "<tr><td>";
+#line 19
+csp_parallel_1_text += std::format(("{}"), (x));
+#line 19
+csp_parallel_1_text += "</td></tr>\n";
+#line 20
+}
+});
+csp_parallel_1.run(csp_parallel_1_executor, 1, [&](std::string& csp_parallel_1_text) {
+#line 21
+for (auto x: list) {
+#line 22
+csp_parallel_1_text += "<tr><td>";
+#line 22
+csp_parallel_1_text += std::format(("{}"), (x * x));
+#line 22
+csp_parallel_1_text += "</td></tr>\n";
+#line 23
+}
+});
+for (auto const& csp_parallel_1_section : csp_parallel_1.wait()) {
+co_yield csp_parallel_1_section;
+}
+}
+#line 24
+co_yield "</table>\n";
+#line 25
+
+}
+
+TEST(parallel_example, parallel_page)
+{
+    auto result = std::string{};
+    for (auto const &s: parallel_page(std::vector{1, 2, 3})) {
+        result += s;
+    }
+
+    auto const expected = std::string{
+        "<table>\n"
+        "<tr><td>1</td></tr>\n"
+        "<tr><td>2</td></tr>\n"
+        "<tr><td>3</td></tr>\n"
+        "<tr><td>1</td></tr>\n"
+        "<tr><td>4</td></tr>\n"
+        "<tr><td>9</td></tr>\n"
+        "</table>\n"
+    };
+
+    ASSERT_EQ(result, expected);
+}
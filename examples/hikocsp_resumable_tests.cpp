@@ -0,0 +1,86 @@
+#line 1 "examples/hikocsp_resumable_tests.cpp.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/resumable_buffer.hpp"
+#include <gtest/gtest.h>
+#include <format>
+#include <vector>
+#include <array>
+#include <span>
+
+class resumable_page {
+public:
+    resumable_page(std::vector<int> list) noexcept : list(std::move(list)) {}
+
+    [[nodiscard]] std::size_t next(std::span<char> buffer)
+    {
+        if (not out.start(buffer)) {
+            return out.size();
+        }
+
+        switch (out.state) {
+        case 0:;
+        
+#line 24
+if (not out.append("\n"
+  "<table>\n")) return out.suspend(1);
+[[fallthrough]];
+case 1:;
+#line 26
+for (i = 0; i != list.size(); ++i) {
+#line 27
+if (not out.append("<tr><td>")) return out.suspend(2);
+[[fallthrough]];
+case 2:;
+#line 27
+if (not out.append(std::format(("{}"), (list[i])))) return out.suspend(3);
+[[fallthrough]];
+case 3:;
+#line 27
+if (not out.append("</td></tr>\n")) return out.suspend(4);
+[[fallthrough]];
+case 4:;
+#line 28
+}
+#line 29
+if (not out.append("</table>\n")) return out.suspend(5);
+[[fallthrough]];
+case 5:;
+#line 30
+
+        }
+        return out.finish();
+    }
+
+private:
+    std::vector<int> list;
+    csp::resumable_buffer out;
+    std::size_t i = 0;
+};
+
+TEST(resumable_example, resumable_page)
+{
+    auto const expected = std::string{
+        "\n<table>\n"
+        "<tr><td>1</td></tr>\n"
+        "<tr><td>22</td></tr>\n"
+        "<tr><td>333</td></tr>\n"
+        "</table>\n"
+    };
+
+    for (auto buffer_size : std::initializer_list<std::size_t>{1, 3, 7, 64}) {
+        auto page = resumable_page(std::vector{1, 22, 333});
+        auto buffer = std::array<char, 64>{};
+
+        auto result = std::string{};
+        while (auto n = page.next(std::span{buffer.data(), buffer_size})) {
+            ASSERT_LE(n, buffer_size);
+            result.append(buffer.data(), n);
+        }
+
+        ASSERT_EQ(result, expected);
+    }
+}
@@ -0,0 +1,42 @@
+#line 1 "examples/hikocsp_static_tests.cpp.csp"
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include <gtest/gtest.h>
+#include <format>
+
+#include <string_view>
+static constexpr auto static_page = std::string_view{
+  "<html>\n"
+  "<h1>Not Found</h1>\n"
+  "<p>Price: 100\x24</p>\n"
+  "</html>\n", 53};
+#line 1 "examples/hikocsp_static_tests.cpp.csp"
+#line 9
+[[nodiscard]] csp::generator<std::string> not_found_page() noexcept
+{
+#line 10
+co_yield static_page;
+#line 14
+}
+
+TEST(static_example, not_found_page)
+{
+    auto result = std::string{};
+    for (auto const &s: not_found_page()) {
+        result += s;
+    }
+
+    auto const expected = std::string{
+        "<html>\n"
+        "<h1>Not Found</h1>\n"
+        "<p>Price: 100$</p>\n"
+        "</html>\n"
+    };
+
+    ASSERT_EQ(result, expected);
+    ASSERT_EQ(static_page, expected);
+    static_assert(static_page.starts_with("<html>"));
+}
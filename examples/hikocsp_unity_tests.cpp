@@ -0,0 +1,101 @@
+#line 1 "examples/hikocsp_unity_list.csp"
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include <gtest/gtest.h>
+#include <format>
+
+static constexpr char text_pool[] =
+  "</td></tr>\n"
+  "\n"
+  "<table>\n"
+  "</table>\n"
+  "<tr><td>\n"
+  "<ul>\n"
+  "</li>\n"
+  "</ul>\n"
+  "<li>";
+#line 1 "examples/hikocsp_unity_list.csp"
+#line 9
+[[nodiscard]] csp::generator<std::string> unity_list_page(std::vector<int> list) noexcept
+{
+#line 10
+co_yield std::string_view{text_pool + 37, 6};
+#line 12
+for (auto x: list) {
+#line 13
+co_yield std::string_view{text_pool + 55, 4};
+#line 13
+co_yield std::format(("{}"), (x));
+#line 13
+co_yield std::string_view{text_pool + 43, 6};
+#line 14
+}
+#line 15
+co_yield std::string_view{text_pool + 49, 6};
+#line 16
+}
+
+TEST(unity_example, unity_list_page)
+{
+    auto result = std::string{};
+    for (auto const &s: unity_list_page(std::vector{1, 2})) {
+        result += s;
+    }
+
+    auto const expected = std::string{
+        "\n<ul>\n"
+        "<li>1</li>\n"
+        "<li>2</li>\n"
+        "</ul>\n"
+    };
+
+    ASSERT_EQ(result, expected);
+}
+#line 1 "examples/hikocsp_unity_table.csp"
+#line 1
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hikocsp/generator.hpp"
+#include <gtest/gtest.h>
+#include <format>
+
+[[nodiscard]] csp::generator<std::string> unity_table_page(std::vector<int> list) noexcept
+{
+#line 10
+co_yield std::string_view{text_pool + 11, 9};
+#line 12
+for (auto x: list) {
+#line 13
+co_yield std::string_view{text_pool + 29, 8};
+#line 13
+co_yield std::format(("{}"), (x));
+#line 13
+co_yield std::string_view{text_pool + 0, 11};
+#line 14
+}
+#line 15
+co_yield std::string_view{text_pool + 20, 9};
+#line 16
+}
+
+TEST(unity_example, unity_table_page)
+{
+    auto result = std::string{};
+    for (auto const &s: unity_table_page(std::vector{1, 2})) {
+        result += s;
+    }
+
+    auto const expected = std::string{
+        "\n<table>\n"
+        "<tr><td>1</td></tr>\n"
+        "<tr><td>2</td></tr>\n"
+        "</table>\n"
+    };
+
+    ASSERT_EQ(result, expected);
+}
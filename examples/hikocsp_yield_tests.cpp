@@ -33,7 +33,7 @@ co_yield (reverse_filter)(std::format(("{}"), (x)));
 #line 24
 co_yield " + ";
 #line 24
-co_yield ([](auto const &x){return x;})(std::format(("{}"), (a)));
+co_yield std::format(("{}"), (a));
 #line 24
 co_yield " = ";
 #line 24
@@ -2,16 +2,85 @@
 #include "hikocsp/csp_parser.hpp"
 #include "hikocsp/csp_translator.hpp"
 #include "hikocsp/option_parser.hpp"
+#include "hikocsp/file_cache.hpp"
+#include "hikocsp/csp_token_stream.hpp"
 #include <format>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <chrono>
+#include <charconv>
+#include <algorithm>
+#include <csignal>
 
-inline int verbose = 0;
-inline std::filesystem::path output_path = {};
-inline std::filesystem::path input_path = {};
-inline bool enable_line = true;
-inline std::optional<std::string> callback_name = std::nullopt;
-inline std::optional<std::string> append_name = std::nullopt;
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HIKOCSP_HAS_UNIX_SOCKET 1
+#define HIKOCSP_HAS_MMAP 1
+#endif
+
+#if !defined(HIKOCSP_VERSION)
+#define HIKOCSP_VERSION "unknown"
+#endif
+
+struct options_type {
+    int verbose = 0;
+    std::filesystem::path output_path = {};
+    std::filesystem::path input_path = {};
+    std::vector<std::filesystem::path> input_paths = {};
+    bool unity = false;
+    bool check = false;
+    std::size_t num_shards = 1;
+    std::filesystem::path depfile_path = {};
+    std::optional<std::filesystem::path> watch_path = std::nullopt;
+    std::optional<std::filesystem::path> server_path = std::nullopt;
+    std::optional<std::filesystem::path> client_path = std::nullopt;
+    std::optional<std::filesystem::path> cache_path = std::nullopt;
+    std::uintmax_t cache_size = 256 * 1024 * 1024;
+    bool cache_statistics = false;
+    std::optional<std::string> stats_format = std::nullopt;
+    bool emit_tokens = false;
+    bool read_tokens = false;
+    bool enable_line = true;
+    bool instrument = false;
+    std::optional<std::string> callback_name = std::nullopt;
+    std::optional<std::string> append_name = std::nullopt;
+    std::optional<std::string> resumable_name = std::nullopt;
+    std::optional<std::string> text_pool_name = std::nullopt;
+    std::optional<std::string> static_name = std::nullopt;
+    std::optional<std::string> module_name = std::nullopt;
+    std::optional<std::string> fragment_cache_name = std::nullopt;
+    std::optional<std::string> flush_name = std::nullopt;
+    std::set<std::string, std::less<>> disabled_passes = {};
+    std::set<std::string, std::less<>> enabled_passes = {};
+};
+
+inline options_type options;
+
+/** The names of the optimization passes, separated by commas.
+ */
+[[nodiscard]] std::string pass_names()
+{
+    auto r = std::string{};
+    for (auto const& pass : csp::csp_passes) {
+        if (not r.empty()) {
+            r += ", ";
+        }
+        r += pass.name;
+    }
+    return r;
+}
 
 void print_help()
 {
@@ -22,39 +91,133 @@ void print_help()
         "  hikocsp --help\n"
         "  hikocsp [ <options> ] <path>\n"
         "  hikocsp [ <options> ] --input=<path>\n"
+        "  hikocsp [ <options> ] --unity --output=<path> <path>...\n"
+        "  hikocsp --check <path>...\n"
+        "  hikocsp [ <options> ] --watch <dir>\n"
+        "  hikocsp --server=<socket>\n"
+        "  hikocsp --client=<socket> [ <options> ] <path>\n"
         "\n"
         "Options:\n"
         "  -h, --help          Show help and exit.\n"
         "  -v, --verbose       Increase verbosity level.\n"
         "  -i, --input=<path>  The path to the template file.\n"
         "  -o, --output=<path> The path to the generated code.\n"
+        "  --depfile=<path>    Write the included templates as a Makefile rule.\n"
+        "  --unity             Translate multiple templates into a single file.\n"
+        "  --shards=<count>    Split the templates of --unity over multiple files.\n"
+        "  --check             Show all errors in the templates, without translating.\n"
+        "  --watch=<dir>       Keep translating the templates in a directory when\n"
+        "                      they, or the templates they include, change.\n"
+        "  --server=<socket>   Translate templates on request of clients\n"
+        "                      connecting to a Unix domain socket.\n"
+        "  --client=<socket>   Let the server translate the template.\n"
+        "  --cache-dir=<dir>   Reuse translations stored in a directory.\n"
+        "  --cache-size=<size> The maximum size of the cache in bytes, optionally\n"
+        "                      with a K, M or G suffix. Default is 256M.\n"
+        "  --cache-stats       Show the statistics of the cache and exit.\n"
+        "  --stats[=json]      Show the statistics of each translation, optionally\n"
+        "                      as a line of JSON.\n"
         "  --callback=<name>   Use a callback function to sink template-text.\n"
         "  --append=<name>     Use a variable to append template-text to.\n"
-        "  --disable-line      Disable generation of #line directives.\n"           
+        "  --resumable=<name>  Generate a resumable state-machine that writes\n"
+        "                      template-text to a csp::resumable_buffer.\n"
+        "  --disable-line      Disable generation of #line directives.\n"
+        "  --instrument        Measure each piece of text and placeholder with\n"
+        "                      a csp::profile_site.\n"
+        "  --emit-tokens       Write the parsed template as a binary token-stream.\n"
+        "  --read-tokens       The input is a token-stream written by --emit-tokens.\n"
+        "  --text-pool=<name>  Pool all static text in a character array.\n"
+        "  --static=<name>     Declare the text of a static template as a\n"
+        "                      std::string_view constant.\n"
+        "  --module=<name>     Generate a module interface unit exporting the\n"
+        "                      template's functions.\n"
+        "  --fragment-cache=<name>\n"
+        "                      The csp::fragment_cache used by ${{@cache}} regions.\n"
+        "  --flush=<name>      The function called at ${{@flush}} points.\n"
+        "  --minify-html       Collapse whitespace in HTML template-text, the same\n"
+        "                      as --enable-pass=minify-html.\n"
+        "  --disable-pass=<name>\n"
+        "                      Disable an optimization pass, or all passes.\n"
+        "  --enable-pass=<name>\n"
+        "                      Enable an optimization pass, or all passes.\n"
         "\n"
         "If the output-path is not specified it is constructed from the\n"
-        "input-path after removing the extension.\n"
+        "input-path after removing the extension. With --emit-tokens the\n"
+        "extension is replaced with .cspt instead.\n"
+        "\n"
+        "With --unity the code of all templates is written to the output-path,\n"
+        "with --text-pool the text of all templates is pooled. With --shards the\n"
+        "templates are split over files of similar size, named like the\n"
+        "output-path with the index of the shard appended to its stem.\n"
+        "\n"
+        "In watch mode each file in the directory with a double extension like\n"
+        "page.hpp.csp is a template, its output-path is constructed in the same\n"
+        "way. Outputs are only written when their content changes.\n"
+        "\n"
+        "In client mode the other options are passed to the server, which\n"
+        "translates the template as if it was run in the client's directory.\n"
+        "When the server is not running the client translates the template itself.\n"
+        "\n"
+        "The cache is keyed on the content of the template, the options and the\n"
+        "version of hikocsp. A cached translation is only used when the included\n"
+        "templates have the same content as well. When the cache is full the\n"
+        "least-recently used translations are removed.\n"
+        "\n"
+        "The statistics are the sizes of the template and the generated code, the\n"
+        "number of tokens of each type, outputs and format calls in the generated\n"
+        "code, and the time spent reading, parsing, translating and writing.\n"
+        "\n"
+        "The optimization passes are, in order: {}.\n"
+        "The minify-html pass is disabled by default.\n"
         "\n"
         "By default the generated code will co_yield the template-text.\n"
-        "You may also use the --callback or --append option to change the\n"
+        "You may also use the --callback, --append or --resumable option to change the\n"
         "way template-text is passed to the caller of the template generating\n"
-        "function.\n");
+        "function.\n",
+        pass_names());
 }
 
-int parse_options(int argc, char *argv[])
+/** Parse a size in bytes.
+ *
+ * @param str A number optionally followed by a K, M or G suffix.
+ * @return The size, or std::nullopt on a parse error.
+ */
+[[nodiscard]] std::optional<std::uintmax_t> parse_size(std::string_view str)
 {
-    auto options = csp::parse_options(argc, argv, "io");
+    auto r = std::uintmax_t{0};
+    auto const [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), r);
+    if (ec != std::errc{}) {
+        return std::nullopt;
+    }
+
+    auto const suffix = std::string_view{ptr, str.data() + str.size()};
+    if (suffix.empty()) {
+        return r;
+    } else if (suffix == "K" or suffix == "k") {
+        return r * 1024;
+    } else if (suffix == "M") {
+        return r * 1024 * 1024;
+    } else if (suffix == "G") {
+        return r * 1024 * 1024 * 1024;
+    } else {
+        return std::nullopt;
+    }
+}
 
-    for (auto& option : options.options) {
+int parse_options(std::vector<std::string_view> const& args)
+{
+    auto result = csp::parse_options(args, "io");
+
+    for (auto& option : result.options) {
         if (option == "-h" or option == "--help") {
             return 1;
 
         } else if (option == "-v" or option == "--verbose") {
-            ++verbose;
+            ++options.verbose;
 
         } else if (option == "-o" or option == "--output") {
             if (option.argument) {
-                output_path = *option.argument;
+                options.output_path = *option.argument;
             } else {
                 std::cerr << std::format("Missing argument for : {}\n", to_string(option));
                 return -1;
@@ -62,15 +225,169 @@ int parse_options(int argc, char *argv[])
 
         } else if (option == "-i" or option == "--input") {
             if (option.argument) {
-                input_path = *option.argument;
+                options.input_path = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--depfile") {
+            if (option.argument) {
+                options.depfile_path = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--unity") {
+            if (not option.argument) {
+                options.unity = true;
+            } else {
+                std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--check") {
+            if (not option.argument) {
+                options.check = true;
+            } else {
+                std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--shards") {
+            if (not option.argument) {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+            auto const& str = *option.argument;
+            auto const [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), options.num_shards);
+            if (ec != std::errc{} or ptr != str.data() + str.size() or options.num_shards == 0) {
+                std::cerr << std::format("Invalid count for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--server") {
+            if (option.argument) {
+                options.server_path = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--client") {
+            if (option.argument) {
+                options.client_path = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--cache-dir") {
+            if (option.argument) {
+                options.cache_path = *option.argument;
             } else {
                 std::cerr << std::format("Missing argument for : {}\n", to_string(option));
                 return -1;
             }
 
+        } else if (option == "--cache-size") {
+            if (not option.argument) {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            } else if (auto size = parse_size(*option.argument)) {
+                options.cache_size = *size;
+            } else {
+                std::cerr << std::format("Invalid size for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--cache-stats") {
+            if (not option.argument) {
+                options.cache_statistics = true;
+            } else {
+                std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--stats") {
+            if (not option.argument) {
+                options.stats_format = "text";
+            } else if (*option.argument == "json") {
+                options.stats_format = "json";
+            } else {
+                std::cerr << std::format("Unknown format for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--watch") {
+            options.watch_path = option.argument ? std::filesystem::path{*option.argument} : std::filesystem::path{};
+
         } else if (option == "--disable-line") {
             if (not option.argument) {
-                enable_line = false;
+                options.enable_line = false;
+            } else {
+                std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--instrument") {
+            if (not option.argument) {
+                options.instrument = true;
+            } else {
+                std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--emit-tokens") {
+            if (not option.argument) {
+                options.emit_tokens = true;
+            } else {
+                std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--read-tokens") {
+            if (not option.argument) {
+                options.read_tokens = true;
+            } else {
+                std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--disable-pass" or option == "--enable-pass") {
+            if (not option.argument) {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+            auto names = std::vector<std::string>{};
+            if (*option.argument == "all") {
+                for (auto const& pass : csp::csp_passes) {
+                    names.emplace_back(pass.name);
+                }
+            } else if (csp::is_csp_pass(*option.argument)) {
+                names.emplace_back(*option.argument);
+            } else {
+                std::cerr << std::format("Unknown optimization pass for : {}\n", to_string(option));
+                return -1;
+            }
+
+            for (auto& name : names) {
+                if (option == "--disable-pass") {
+                    options.enabled_passes.erase(name);
+                    options.disabled_passes.insert(std::move(name));
+                } else {
+                    options.disabled_passes.erase(name);
+                    options.enabled_passes.insert(std::move(name));
+                }
+            }
+
+        } else if (option == "--minify-html") {
+            if (not option.argument) {
+                options.disabled_passes.erase("minify-html");
+                options.enabled_passes.insert("minify-html");
             } else {
                 std::cerr << std::format("Unexpected argument for : {}\n", to_string(option));
                 return -1;
@@ -78,7 +395,7 @@ int parse_options(int argc, char *argv[])
 
         } else if (option == "--callback") {
             if (option.argument) {
-                callback_name = *option.argument;
+                options.callback_name = *option.argument;
             } else {
                 std::cerr << std::format("Missing argument for : {}\n", to_string(option));
                 return -1;
@@ -86,7 +403,55 @@ int parse_options(int argc, char *argv[])
 
         } else if (option == "--append") {
             if (option.argument) {
-                append_name = *option.argument;
+                options.append_name = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--resumable") {
+            if (option.argument) {
+                options.resumable_name = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--text-pool") {
+            if (option.argument) {
+                options.text_pool_name = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--static") {
+            if (option.argument) {
+                options.static_name = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--module") {
+            if (option.argument) {
+                options.module_name = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--fragment-cache") {
+            if (option.argument) {
+                options.fragment_cache_name = *option.argument;
+            } else {
+                std::cerr << std::format("Missing argument for : {}\n", to_string(option));
+                return -1;
+            }
+
+        } else if (option == "--flush") {
+            if (option.argument) {
+                options.flush_name = *option.argument;
             } else {
                 std::cerr << std::format("Missing argument for : {}\n", to_string(option));
                 return -1;
@@ -98,29 +463,110 @@ int parse_options(int argc, char *argv[])
         }
     }
 
-    if (input_path.empty()) {
-        if (options.arguments.size() == 1) {
-            input_path = options.arguments.front();
+    if (options.cache_statistics) {
+        if (not options.cache_path) {
+            std::cerr << std::format("--cache-stats requires --cache-dir.\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (options.server_path) {
+        if (not result.arguments.empty()) {
+            std::cerr << std::format("--server does not take a template path.\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (options.watch_path) {
+        if (options.watch_path->empty() and result.arguments.size() == 1) {
+            options.watch_path = result.arguments.front();
+        } else if (not result.arguments.empty()) {
+            std::cerr << std::format("Unexpected non-option arguments {}.\n", result.arguments.front());
+            return -1;
+        }
+
+        if (options.watch_path->empty()) {
+            std::cerr << std::format("Expecting a directory to watch.\n");
+            return -1;
+        }
+        if (not options.input_path.empty() or not options.output_path.empty() or not options.depfile_path.empty()) {
+            std::cerr << std::format("--watch can not be combined with --input, --output or --depfile.\n");
+            return -1;
+        }
+        if (options.emit_tokens or options.read_tokens) {
+            std::cerr << std::format("--watch can not be combined with --emit-tokens or --read-tokens.\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (options.num_shards != 1 and not options.unity) {
+        std::cerr << std::format("--shards requires --unity.\n");
+        return -1;
+    }
+
+    if (options.check or options.unity) {
+        if (not options.input_path.empty()) {
+            options.input_paths.push_back(options.input_path);
+        }
+        for (auto const& argument : result.arguments) {
+            options.input_paths.emplace_back(argument);
+        }
+
+        if (options.input_paths.empty()) {
+            std::cerr << std::format("Expecting one or more templates.\n");
+            return -1;
+        }
+        if (options.check) {
+            return 0;
+        }
+        if (options.output_path.empty()) {
+            std::cerr << std::format("--unity requires --output.\n");
+            return -1;
+        }
+        if (options.emit_tokens or options.read_tokens or options.static_name or options.cache_path) {
+            std::cerr << std::format("--unity can not be combined with --emit-tokens, --read-tokens, --static or --cache-dir.\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (options.input_path.empty()) {
+        if (result.arguments.size() == 1) {
+            options.input_path = result.arguments.front();
         } else {
             std::cerr << std::format("Expecting a non-option argument intput-path.\n");
             return -1;
         }
 
-    } else if (not options.arguments.empty()) {
-        std::cerr << std::format("Unexpected non-option arguments {}.\n", options.arguments.front());
+    } else if (not result.arguments.empty()) {
+        std::cerr << std::format("Unexpected non-option arguments {}.\n", result.arguments.front());
+        return -1;
+    }
+
+    if (options.emit_tokens and options.read_tokens) {
+        std::cerr << std::format("--emit-tokens can not be combined with --read-tokens.\n");
         return -1;
     }
 
-    if (output_path.empty()) {
-        if (not input_path.has_extension()) {
-            std::cerr << std::format("Can not produce output-path from intput-path {}.\n", input_path.string());
+    if (options.output_path.empty()) {
+        if (not options.input_path.has_extension()) {
+            std::cerr << std::format("Can not produce output-path from intput-path {}.\n", options.input_path.string());
             return -1;
         }
 
-        output_path = input_path.parent_path() / input_path.stem();
-        if (verbose > 0) {
+        options.output_path = options.input_path.parent_path() / options.input_path.stem();
+        if (options.emit_tokens) {
+            options.output_path += ".cspt";
+        }
+        // In client mode the server reports this instead.
+        if (options.verbose > 0 and not options.client_path) {
             std::cerr << std::format(
-                "Using output-path {} constructed from input-path {}.\n", output_path.string(), input_path.string());
+                "Using output-path {} constructed from input-path {}.\n",
+                options.output_path.string(),
+                options.input_path.string());
         }
     }
 
@@ -138,32 +584,1257 @@ int parse_options(int argc, char *argv[])
     return r;
 }
 
-int main(int argc, char *argv[])
+/** Escape a path for use in a Makefile rule.
+ */
+[[nodiscard]] std::string make_escape(std::filesystem::path const& path)
 {
-    if (auto parse_state = parse_options(argc, argv)) {
-        print_help();
-        return parse_state == 1 ? 0 : -2;
+    auto r = std::string{};
+    for (auto c : path.generic_string()) {
+        if (c == ' ' or c == '#') {
+            r += '\\';
+        } else if (c == '$') {
+            r += '$';
+        }
+        r += c;
+    }
+    return r;
+}
+
+void write_depfile(
+    std::filesystem::path const& path,
+    std::vector<std::filesystem::path> const& targets,
+    std::filesystem::path const& source,
+    std::vector<std::filesystem::path> const& dependencies)
+{
+    auto f = std::ofstream(path);
+    if (not f.is_open()) {
+        throw std::runtime_error(std::format("Could not open file {}.", path.string()));
     }
 
-    try {
-        auto text = read_file(input_path);
-        auto tokens = csp::parse_csp(text, input_path);
+    for (auto it = targets.begin(); it != targets.end(); ++it) {
+        f << (it == targets.begin() ? "" : " ") << make_escape(*it);
+    }
+    f << ": " << make_escape(source);
+    for (auto const& dependency : dependencies) {
+        f << " \\\n  " << make_escape(dependency);
+    }
+    f << "\n";
+    f.close();
+}
 
-        auto config = csp::translate_csp_config{};
-        config.enable_line = enable_line;
-        config.callback_name = callback_name;
-        config.append_name = append_name;
+/** A read-only file mapped into memory.
+ *
+ * On platforms without mmap() the file is read into memory instead.
+ */
+class mapped_file {
+public:
+    explicit mapped_file(std::filesystem::path const& path)
+    {
+#if defined(HIKOCSP_HAS_MMAP)
+        auto const fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw std::runtime_error(std::format("Could not open file {}.", path.string()));
+        }
 
-        auto f = std::ofstream(output_path);
-        for (auto const& str : csp::translate_csp(tokens.begin(), tokens.end(), input_path, config)) {
-            f << str;
+        struct stat info;
+        if (fstat(fd, &info) == -1) {
+            close(fd);
+            throw std::runtime_error(std::format("Could not stat file {}.", path.string()));
         }
-        f.close();
 
-    } catch (std::exception const& e) {
-        std::cerr << std::format("Could not translate template: {}.", e.what());
-        return -1;
+        _size = static_cast<std::size_t>(info.st_size);
+        if (_size != 0) {
+            _data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+
+        if (_data == MAP_FAILED) {
+            throw std::runtime_error(std::format("Could not map file {}.", path.string()));
+        }
+#else
+        _text = read_file(path);
+#endif
     }
 
-    return 0;
+    ~mapped_file()
+    {
+#if defined(HIKOCSP_HAS_MMAP)
+        if (_data != nullptr and _data != MAP_FAILED) {
+            munmap(_data, _size);
+        }
+#endif
+    }
+
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    [[nodiscard]] std::string_view view() const noexcept
+    {
+#if defined(HIKOCSP_HAS_MMAP)
+        return _data ? std::string_view{static_cast<char const *>(_data), _size} : std::string_view{};
+#else
+        return _text;
+#endif
+    }
+
+private:
+#if defined(HIKOCSP_HAS_MMAP)
+    void *_data = nullptr;
+    std::size_t _size = 0;
+#else
+    std::string _text;
+#endif
+};
+
+/** Statistics of the translation of a template, shown with --stats.
+ */
+struct translation_statistics {
+    std::filesystem::path path = {};
+
+    /** False when the translation was taken from a cache.
+     */
+    bool translated = false;
+
+    std::size_t bytes_in = 0;
+    std::size_t bytes_out = 0;
+    std::map<csp::csp_token_type, std::size_t> num_tokens = {};
+    csp::translate_csp_statistics translate = {};
+
+    std::chrono::nanoseconds read_time = {};
+    std::chrono::nanoseconds parse_time = {};
+    std::chrono::nanoseconds translate_time = {};
+    std::chrono::nanoseconds write_time = {};
+};
+
+inline translation_statistics statistics;
+
+/** Measures the wall time of consecutive phases.
+ */
+class stopwatch {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /** The time since the previous lap, or since the stopwatch was created.
+     */
+    [[nodiscard]] std::chrono::nanoseconds lap() noexcept
+    {
+        auto const now = clock::now();
+        auto const r = std::chrono::duration_cast<std::chrono::nanoseconds>(now - _start);
+        _start = now;
+        return r;
+    }
+
+private:
+    clock::time_point _start = clock::now();
+};
+
+/** Escape a string for use as a JSON string, including the quotes.
+ */
+[[nodiscard]] std::string json_string(std::string_view str)
+{
+    auto r = std::string{"\""};
+    for (auto c : str) {
+        if (c == '"' or c == '\\') {
+            r += '\\';
+            r += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            r += std::format("\\u{:04x}", static_cast<unsigned char>(c));
+        } else {
+            r += c;
+        }
+    }
+    r += '"';
+    return r;
+}
+
+/** Show the statistics of the last translation, in the format selected with --stats.
+ */
+void print_statistics()
+{
+    auto const milliseconds = [](std::chrono::nanoseconds duration) {
+        return std::chrono::duration<double, std::milli>{duration}.count();
+    };
+
+    if (options.stats_format == "json") {
+        auto tokens = std::string{};
+        for (auto const& [kind, count] : statistics.num_tokens) {
+            tokens += std::format("{}{}: {}", tokens.empty() ? "" : ", ", json_string(to_string(kind)), count);
+        }
+
+        std::cerr << std::format(
+            "{{\"path\": {}, \"translated\": {}, \"bytes_in\": {}, \"bytes_out\": {}, \"tokens\": {{{}}}, "
+            "\"outputs\": {}, \"format_calls\": {}, \"read_ns\": {}, \"parse_ns\": {}, \"translate_ns\": {}, "
+            "\"write_ns\": {}}}\n",
+            json_string(statistics.path.generic_string()),
+            statistics.translated,
+            statistics.bytes_in,
+            statistics.bytes_out,
+            tokens,
+            statistics.translate.num_outputs,
+            statistics.translate.num_format_calls,
+            statistics.read_time.count(),
+            statistics.parse_time.count(),
+            statistics.translate_time.count(),
+            statistics.write_time.count());
+        return;
+    }
+
+    auto tokens = std::string{};
+    for (auto const& [kind, count] : statistics.num_tokens) {
+        tokens += std::format("{}{} {}", tokens.empty() ? "" : ", ", count, to_string(kind));
+    }
+
+    std::cerr << std::format(
+        "{}{}:\n"
+        "  bytes: {} in, {} out\n"
+        "  tokens: {}\n"
+        "  generated: {} outputs, {} format calls\n"
+        "  time: read {:.3f} ms, parse {:.3f} ms, translate {:.3f} ms, write {:.3f} ms\n",
+        statistics.path.string(),
+        statistics.translated ? "" : " (cached)",
+        statistics.bytes_in,
+        statistics.bytes_out,
+        tokens.empty() ? "none" : tokens,
+        statistics.translate.num_outputs,
+        statistics.translate.num_format_calls,
+        milliseconds(statistics.read_time),
+        milliseconds(statistics.parse_time),
+        milliseconds(statistics.translate_time),
+        milliseconds(statistics.write_time));
+}
+
+struct translation {
+    /** The generated code. */
+    std::string code;
+
+    /** The paths of the templates included by the template. */
+    std::vector<std::filesystem::path> dependencies;
+};
+
+/** The configuration for translating templates, from the options.
+ */
+[[nodiscard]] csp::translate_csp_config translate_config()
+{
+    auto r = csp::translate_csp_config{};
+    r.enable_line = options.enable_line;
+    r.callback_name = options.callback_name;
+    r.append_name = options.append_name;
+    r.resumable_name = options.resumable_name;
+    r.text_pool_name = options.text_pool_name;
+    r.static_name = options.static_name;
+    r.module_name = options.module_name;
+    if (options.fragment_cache_name) {
+        r.fragment_cache_name = *options.fragment_cache_name;
+    }
+    r.flush_name = options.flush_name;
+    r.instrument = options.instrument;
+    r.disabled_passes = options.disabled_passes;
+    r.enabled_passes = options.enabled_passes;
+    r.statistics = &statistics.translate;
+    return r;
+}
+
+/** Translate a template into C++ code.
+ *
+ * The statistics of the translation are stored in `statistics`, except for
+ * the time spent reading the template.
+ *
+ * @param template_path The path to the template.
+ * @param text The content of the template, already read by the caller.
+ */
+[[nodiscard]] translation translate_template(std::filesystem::path const& template_path, std::string_view text)
+{
+    auto watch = stopwatch{};
+    statistics.translated = true;
+    statistics.bytes_in = text.size();
+
+    auto r = translation{};
+    auto parse_config = csp::parse_csp_config{};
+    parse_config.dependencies = &r.dependencies;
+
+    auto const config = translate_config();
+
+    if (options.read_tokens) {
+        auto const stream = csp::csp_token_stream{text};
+
+        for (auto const& token : stream) {
+            ++statistics.num_tokens[token.kind];
+        }
+        statistics.parse_time = watch.lap();
+
+        for (auto const& str : csp::translate_csp(stream.begin(), stream.end(), stream.path(), config)) {
+            r.code += str;
+        }
+        statistics.translate_time = watch.lap();
+        return r;
+    }
+
+    // Parse all tokens before translating, so that each phase is timed separately.
+    auto tokens = std::vector<csp::csp_token<std::string_view::const_iterator>>{};
+    for (auto& token : csp::parse_csp(text, template_path, parse_config)) {
+        ++statistics.num_tokens[token.kind];
+        tokens.push_back(std::move(token));
+    }
+    statistics.parse_time = watch.lap();
+
+    if (options.emit_tokens) {
+        r.code = csp::serialize_csp_tokens(tokens.begin(), tokens.end(), template_path);
+        statistics.translate_time = watch.lap();
+        return r;
+    }
+
+    for (auto const& str : csp::translate_csp(tokens.begin(), tokens.end(), template_path, config)) {
+        r.code += str;
+    }
+    statistics.translate_time = watch.lap();
+    return r;
+}
+
+/** Read and translate a template into C++ code.
+ *
+ * The statistics of the translation are stored in `statistics`.
+ *
+ * @param template_path The path to the template.
+ */
+[[nodiscard]] translation translate_template(std::filesystem::path const& template_path)
+{
+    auto watch = stopwatch{};
+    auto const file = mapped_file{template_path};
+    statistics.read_time = watch.lap();
+
+    return translate_template(template_path, file.view());
+}
+
+/** Write generated code to a file.
+ *
+ * @param path The path to the generated code.
+ * @param code The generated code.
+ * @param only_if_changed Do not write the file when it already has the same content.
+ */
+void write_code(std::filesystem::path const& path, std::string const& code, bool only_if_changed)
+{
+    auto watch = stopwatch{};
+    statistics.bytes_out = code.size();
+
+    if (only_if_changed and std::filesystem::exists(path) and read_file(path) == code) {
+        if (options.verbose > 0) {
+            std::cerr << std::format("Output {} is unchanged.\n", path.string());
+        }
+        statistics.write_time = watch.lap();
+        return;
+    }
+
+    auto f = std::ofstream(path, options.emit_tokens ? std::ios::binary : std::ios::openmode{});
+    if (not f.is_open()) {
+        throw std::runtime_error(std::format("Could not open file {}.", path.string()));
+    }
+    f << code;
+    f.close();
+    statistics.write_time = watch.lap();
+}
+
+/** The options that change the generated code.
+ */
+[[nodiscard]] std::string translate_options_key()
+{
+    auto passes = std::string{};
+    for (auto const& name : options.disabled_passes) {
+        passes += std::format("-{} ", name);
+    }
+    for (auto const& name : options.enabled_passes) {
+        passes += std::format("+{} ", name);
+    }
+
+    return std::format(
+        "{}\n{}\n{}\n{}\n{}\n{}\n{}\n{}\n{}\n{}\n{}\n{}\n{}",
+        passes,
+        options.emit_tokens,
+        options.read_tokens,
+        options.enable_line,
+        options.instrument,
+        options.callback_name.value_or(""),
+        options.append_name.value_or(""),
+        options.resumable_name.value_or(""),
+        options.text_pool_name.value_or(""),
+        options.static_name.value_or(""),
+        options.module_name.value_or(""),
+        options.fragment_cache_name.value_or(""),
+        options.flush_name.value_or(""));
+}
+
+/** Encode a translation for the cache.
+ *
+ * The code is preceded by the number of dependencies, and a line for each
+ * dependency with the hash of its content and its path.
+ */
+[[nodiscard]] std::string encode_cache_entry(translation const& value)
+{
+    auto r = std::format("{}\n", value.dependencies.size());
+    for (auto const& dependency : value.dependencies) {
+        r += std::format("{:016x} {}\n", csp::fnv1a_hash(read_file(dependency)), dependency.string());
+    }
+    r += value.code;
+    return r;
+}
+
+/** Decode a translation from the cache.
+ *
+ * @return The translation, or std::nullopt if the entry is invalid or an
+ *         included template has changed.
+ */
+[[nodiscard]] std::optional<translation> decode_cache_entry(std::string_view str)
+{
+    auto const next_line = [&str]() -> std::optional<std::string_view> {
+        auto const i = str.find('\n');
+        if (i == str.npos) {
+            return std::nullopt;
+        }
+        auto const r = str.substr(0, i);
+        str = str.substr(i + 1);
+        return r;
+    };
+
+    auto r = translation{};
+
+    auto const count_line = next_line();
+    auto count = std::size_t{0};
+    if (not count_line or std::from_chars(count_line->data(), count_line->data() + count_line->size(), count).ec != std::errc{}) {
+        return std::nullopt;
+    }
+
+    for (auto i = std::size_t{0}; i != count; ++i) {
+        auto const line = next_line();
+        auto hash = uint64_t{0};
+        if (not line or line->size() < 18 or std::from_chars(line->data(), line->data() + 16, hash, 16).ec != std::errc{}) {
+            return std::nullopt;
+        }
+
+        auto const& dependency = r.dependencies.emplace_back(line->substr(17));
+        auto ec = std::error_code{};
+        if (not std::filesystem::exists(dependency, ec) or csp::fnv1a_hash(read_file(dependency)) != hash) {
+            return std::nullopt;
+        }
+    }
+
+    r.code = str;
+    return r;
+}
+
+/** Translate a template, or reuse a translation from the cache when --cache-dir is given.
+ *
+ * @param template_path The path to the template.
+ */
+[[nodiscard]] translation translate_cached(std::filesystem::path const& template_path)
+{
+    if (not options.cache_path) {
+        return translate_template(template_path);
+    }
+
+    // The template is read once, for both the key and the translation.
+    auto watch = stopwatch{};
+    auto const file = mapped_file{template_path};
+    statistics.read_time = watch.lap();
+
+    // The path is part of the key as it is used in the #line directives.
+    auto key = csp::fnv1a_hash(HIKOCSP_VERSION "\n");
+    key = csp::fnv1a_hash(std::format("{}\n{}\n", template_path.string(), std::filesystem::absolute(template_path).string()), key);
+    key = csp::fnv1a_hash(translate_options_key(), key);
+    key = csp::fnv1a_hash(file.view(), key);
+
+    auto cache = csp::file_cache{*options.cache_path, options.cache_size};
+    auto r = std::optional<translation>{};
+    auto const is_valid = [&r](std::string const& entry) {
+        r = decode_cache_entry(entry);
+        return r.has_value();
+    };
+
+    if (cache.get(key, is_valid)) {
+        cache.save_statistics();
+        if (options.verbose > 0) {
+            std::cerr << std::format("Using cached translation of {}.\n", template_path.string());
+        }
+        return *std::move(r);
+    }
+
+    r = translate_template(template_path, file.view());
+    cache.put(key, encode_cache_entry(*r));
+    cache.save_statistics();
+    return *std::move(r);
+}
+
+/** Show the statistics of the cache.
+ */
+void print_cache_statistics()
+{
+    auto const cache = csp::file_cache{*options.cache_path, options.cache_size};
+    auto const statistics = cache.load_statistics();
+    std::cout << std::format(
+        "hits: {}\nmisses: {}\nhit-rate: {:.1f}%\nevictions: {}\nsize: {} of {} bytes\n",
+        statistics.hits,
+        statistics.misses,
+        statistics.hit_rate() * 100.0,
+        statistics.evictions,
+        cache.size(),
+        cache.max_size());
+}
+
+/** Translate a template into a C++ file.
+ *
+ * @param template_path The path to the template.
+ * @param generated_path The path to the generated code.
+ * @param only_if_changed Do not write the output when the file already has the same content.
+ * @return The paths of the templates included by the template.
+ */
+std::vector<std::filesystem::path>
+translate_file(std::filesystem::path const& template_path, std::filesystem::path const& generated_path, bool only_if_changed)
+{
+    statistics = translation_statistics{template_path};
+    auto r = translate_cached(template_path);
+    write_code(generated_path, r.code, only_if_changed);
+    if (options.stats_format) {
+        print_statistics();
+    }
+    return std::move(r.dependencies);
+}
+
+/** Translations of templates kept in memory by the server.
+ */
+class translation_cache {
+public:
+    /** Translate a template, or reuse the previous translation.
+     *
+     * The previous translation is reused when the template and the templates
+     * it includes were not modified, and the options are the same.
+     */
+    [[nodiscard]] translation const& translate(std::filesystem::path const& template_path)
+    {
+        auto const key =
+            std::format("{}\n{}", std::filesystem::absolute(template_path).generic_string(), translate_options_key());
+
+        auto it = _entries.find(key);
+        if (it != _entries.end() and is_fresh(it->second)) {
+            ++_hits;
+            return it->second.value;
+        }
+
+        ++_misses;
+        auto e = entry{translate_cached(template_path)};
+        e.stamps.emplace_back(std::filesystem::absolute(template_path), 0, std::filesystem::file_time_type{});
+        for (auto const& dependency : e.value.dependencies) {
+            e.stamps.emplace_back(std::filesystem::absolute(dependency), 0, std::filesystem::file_time_type{});
+        }
+        for (auto& [path, size, time] : e.stamps) {
+            size = std::filesystem::file_size(path);
+            time = std::filesystem::last_write_time(path);
+        }
+
+        return (_entries[key] = std::move(e)).value;
+    }
+
+    [[nodiscard]] std::size_t hits() const noexcept
+    {
+        return _hits;
+    }
+
+    [[nodiscard]] std::size_t misses() const noexcept
+    {
+        return _misses;
+    }
+
+private:
+    struct entry {
+        translation value;
+        std::vector<std::tuple<std::filesystem::path, std::uintmax_t, std::filesystem::file_time_type>> stamps = {};
+    };
+
+    std::map<std::string, entry> _entries;
+    std::size_t _hits = 0;
+    std::size_t _misses = 0;
+
+    [[nodiscard]] static bool is_fresh(entry const& e) noexcept
+    {
+        for (auto const& [path, size, time] : e.stamps) {
+            auto ec = std::error_code{};
+            if (std::filesystem::file_size(path, ec) != size or ec) {
+                return false;
+            }
+            if (std::filesystem::last_write_time(path, ec) != time or ec) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/** The path of a file of a unity build.
+ *
+ * @param index The index of the shard.
+ * @return The output-path, with the index appended to its stem when there are multiple shards.
+ */
+[[nodiscard]] std::filesystem::path shard_path(std::size_t index)
+{
+    if (options.num_shards == 1) {
+        return options.output_path;
+    }
+
+    auto r = options.output_path.parent_path() / options.output_path.stem();
+    r += std::format("_{}", index);
+    r += options.output_path.extension();
+    return r;
+}
+
+/** Split the templates of a unity build over the shards.
+ *
+ * Each template, largest first, is added to the shard with the smallest total
+ * size, so that the shards take a similar time to compile. Inside a shard the
+ * templates keep the order in which they were given.
+ *
+ * @return The indices of the templates in each shard.
+ */
+[[nodiscard]] std::vector<std::vector<std::size_t>> split_shards()
+{
+    auto sizes = std::vector<std::uintmax_t>{};
+    auto order = std::vector<std::size_t>{};
+    for (auto const& path : options.input_paths) {
+        order.push_back(sizes.size());
+        sizes.push_back(std::filesystem::file_size(path));
+    }
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+        return sizes[a] > sizes[b];
+    });
+
+    auto r = std::vector<std::vector<std::size_t>>(options.num_shards);
+    auto totals = std::vector<std::uintmax_t>(options.num_shards, 0);
+    for (auto const i : order) {
+        auto const shard = static_cast<std::size_t>(std::distance(totals.begin(), std::min_element(totals.begin(), totals.end())));
+        r[shard].push_back(i);
+        totals[shard] += sizes[i];
+    }
+
+    for (auto& shard : r) {
+        std::sort(shard.begin(), shard.end());
+    }
+    return r;
+}
+
+/** Translate the templates selected by --unity into one or more files.
+ *
+ * @return The exit code.
+ */
+int translate_unity()
+{
+    try {
+        auto targets = std::vector<std::filesystem::path>{};
+        auto dependencies = std::vector<std::filesystem::path>{};
+        auto const shards = split_shards();
+
+        for (auto shard = std::size_t{0}; shard != shards.size(); ++shard) {
+            targets.push_back(shard_path(shard));
+            statistics = translation_statistics{targets.back()};
+            statistics.translated = true;
+
+            auto templates = std::vector<csp::csp_unity_template>{};
+            for (auto const i : shards[shard]) {
+                auto const& path = options.input_paths[i];
+                auto watch = stopwatch{};
+
+                auto parse_config = csp::parse_csp_config{};
+                parse_config.dependencies = &dependencies;
+
+                auto const text = read_file(path);
+                statistics.bytes_in += text.size();
+                statistics.read_time += watch.lap();
+
+                auto tokens = std::vector<csp::csp_token<std::string_view::const_iterator>>{};
+                for (auto& token : csp::parse_csp(text, path, parse_config)) {
+                    ++statistics.num_tokens[token.kind];
+                    tokens.push_back(std::move(token));
+                }
+                statistics.parse_time += watch.lap();
+
+                auto ir = csp::lower_csp(tokens.begin(), tokens.end());
+                csp::run_csp_passes(ir, options.disabled_passes, options.enabled_passes);
+                templates.emplace_back(std::move(ir), path);
+                statistics.translate_time += watch.lap();
+            }
+
+            auto watch = stopwatch{};
+            auto code = std::string{};
+            for (auto const& str : csp::translate_csp_unity(std::move(templates), translate_config())) {
+                code += str;
+            }
+            statistics.translate_time += watch.lap();
+
+            write_code(targets.back(), code, false);
+            if (options.stats_format) {
+                print_statistics();
+            }
+        }
+
+        if (not options.depfile_path.empty()) {
+            dependencies.insert(dependencies.begin(), std::next(options.input_paths.begin()), options.input_paths.end());
+            write_depfile(options.depfile_path, targets, options.input_paths.front(), dependencies);
+        }
+
+    } catch (std::exception const& e) {
+        std::cerr << std::format("Could not translate template: {}.", e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+/** Check the templates selected by --check for errors.
+ *
+ * All errors of each template are shown, like compiler errors.
+ *
+ * @return The exit code, -1 when a template has errors.
+ */
+int check_main()
+{
+    auto exit_code = 0;
+    for (auto const& path : options.input_paths) {
+        try {
+            for (auto const& diagnostic : csp::check_csp(read_file(path), path)) {
+                std::cerr << std::format("{}\n", to_string(diagnostic));
+                exit_code = -1;
+            }
+
+        } catch (std::exception const& e) {
+            std::cerr << std::format("Could not check template: {}.\n", e.what());
+            exit_code = -1;
+        }
+    }
+
+    if (options.verbose > 0) {
+        std::cerr << std::format("Checked {} templates.\n", options.input_paths.size());
+    }
+    return exit_code;
+}
+
+/** Translate the template selected by the options.
+ *
+ * @param cache When not null, used to reuse earlier translations.
+ * @return The exit code.
+ */
+int translate_main(translation_cache *cache)
+{
+    if (options.check) {
+        return check_main();
+    } else if (options.unity) {
+        return translate_unity();
+    }
+
+    try {
+        statistics = translation_statistics{options.input_path};
+        auto fresh = translation{};
+        auto const& r = cache ? cache->translate(options.input_path) : (fresh = translate_cached(options.input_path));
+
+        write_code(options.output_path, r.code, false);
+        if (options.stats_format) {
+            print_statistics();
+        }
+
+        if (not options.depfile_path.empty()) {
+            write_depfile(options.depfile_path, {options.output_path}, options.input_path, r.dependencies);
+        }
+
+    } catch (std::exception const& e) {
+        std::cerr << std::format("Could not translate template: {}.", e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+#if defined(__linux__)
+/** Templates being watched, and the templates they include.
+ */
+class watched_templates {
+public:
+    /** Translate a template and remember which templates it includes.
+     */
+    void translate(std::filesystem::path const& path) noexcept
+    {
+        auto const generated_path = path.parent_path() / path.stem();
+        try {
+            auto dependencies = translate_file(path, generated_path, true);
+
+            // Canonicalize once, instead of on every change.
+            auto& canonical_dependencies = _dependencies[path];
+            canonical_dependencies.clear();
+            for (auto const& dependency : dependencies) {
+                canonical_dependencies.insert(std::filesystem::weakly_canonical(dependency));
+            }
+            if (options.verbose > 0) {
+                std::cerr << std::format("Translated {}.\n", path.string());
+            }
+
+        } catch (std::exception const& e) {
+            // Keep the previous dependencies, so that fixing an included template retries.
+            _dependencies.try_emplace(path);
+            std::cerr << std::format("Could not translate template: {}.\n", e.what());
+        }
+    }
+
+    /** Retranslate templates after a file has changed.
+     *
+     * @param path The path of the file that has changed.
+     * @param in_tree The file is in the watched directory, instead of only
+     *                in the directory of an included template.
+     */
+    void changed(std::filesystem::path const& path, bool in_tree) noexcept
+    {
+        auto const canonical_path = std::filesystem::weakly_canonical(path);
+
+        auto to_translate = std::set<std::filesystem::path>{};
+        if (in_tree and is_template(path)) {
+            to_translate.insert(path);
+        }
+        for (auto const& [template_path, dependencies] : _dependencies) {
+            if (dependencies.contains(canonical_path)) {
+                to_translate.insert(template_path);
+            }
+        }
+
+        for (auto const& template_path : to_translate) {
+            translate(template_path);
+        }
+    }
+
+    /** Forget the templates in a file or directory that was removed.
+     *
+     * @param path The path of the file or directory that was deleted or moved away.
+     */
+    void removed(std::filesystem::path const& path) noexcept
+    {
+        std::erase_if(_dependencies, [&path](auto const& item) {
+            auto const& template_path = item.first;
+            return std::mismatch(path.begin(), path.end(), template_path.begin(), template_path.end()).first == path.end();
+        });
+    }
+
+    /** The directories of the included templates.
+     */
+    [[nodiscard]] std::set<std::filesystem::path> dependency_directories() const
+    {
+        auto r = std::set<std::filesystem::path>{};
+        for (auto const& [template_path, dependencies] : _dependencies) {
+            for (auto const& dependency : dependencies) {
+                r.insert(dependency.parent_path());
+            }
+        }
+        return r;
+    }
+
+    /** Check if a file is a template, with a double extension like page.hpp.csp.
+     */
+    [[nodiscard]] static bool is_template(std::filesystem::path const& path) noexcept
+    {
+        return path.extension() == ".csp" and path.stem().has_extension();
+    }
+
+private:
+    std::map<std::filesystem::path, std::set<std::filesystem::path>> _dependencies;
+};
+
+/** Translate the templates in a directory, and keep translating them when they change.
+ */
+[[noreturn]] void watch(std::filesystem::path const& directory)
+{
+    auto const fd = inotify_init1(IN_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("Could not initialize inotify.");
+    }
+
+    auto templates = watched_templates{};
+    auto directories = std::map<int, std::filesystem::path>{};
+    auto watched = std::set<std::filesystem::path>{};
+
+    // Directories outside of the watched directory, containing included templates.
+    auto outside_directories = std::set<int>{};
+
+    auto const add_watch = [&](std::filesystem::path const& path) {
+        auto const wd =
+            inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM);
+        if (wd == -1) {
+            throw std::runtime_error(std::format("Could not watch directory {}.", path.string()));
+        }
+        directories[wd] = path;
+        watched.insert(std::filesystem::weakly_canonical(path));
+        return wd;
+    };
+
+    // Watch a directory and its sub-directories; a directory created by
+    // mkdir -p, cp -r or git checkout may already contain files and directories.
+    auto const add_directory = [&](std::filesystem::path const& path) {
+        outside_directories.erase(add_watch(path));
+        for (auto const& entry : std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_directory()) {
+                outside_directories.erase(add_watch(entry.path()));
+            }
+        }
+
+        for (auto const& entry : std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() and watched_templates::is_template(entry.path())) {
+                templates.translate(entry.path());
+            }
+        }
+    };
+
+    auto const add_dependency_directories = [&] {
+        for (auto const& path : templates.dependency_directories()) {
+            if (not watched.contains(path) and std::filesystem::is_directory(path)) {
+                outside_directories.insert(add_watch(path));
+            }
+        }
+    };
+
+    add_directory(directory);
+    add_dependency_directories();
+
+    if (options.verbose > 0) {
+        std::cerr << std::format("Watching {}.\n", directory.string());
+    }
+
+    alignas(inotify_event) char buffer[65536];
+    while (true) {
+        auto const size = read(fd, buffer, sizeof(buffer));
+        if (size <= 0) {
+            throw std::runtime_error("Could not read inotify events.");
+        }
+
+        // An editor may write a file multiple times, handle each file once per read.
+        auto changed = std::map<std::filesystem::path, bool>{};
+        for (auto ptr = buffer; ptr < buffer + size;) {
+            auto const& event = *reinterpret_cast<inotify_event const *>(ptr);
+            ptr += sizeof(inotify_event) + event.len;
+
+            if (event.len == 0 or not directories.contains(event.wd)) {
+                continue;
+            }
+
+            auto const path = directories[event.wd] / event.name;
+            auto const in_tree = not outside_directories.contains(event.wd);
+            if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+                changed.erase(path);
+                templates.removed(path);
+            } else if (event.mask & IN_ISDIR) {
+                if (in_tree and (event.mask & (IN_CREATE | IN_MOVED_TO))) {
+                    add_directory(path);
+                }
+            } else if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                changed.emplace(path, in_tree);
+            }
+        }
+
+        for (auto const& [path, in_tree] : changed) {
+            templates.changed(path, in_tree);
+        }
+        add_dependency_directories();
+    }
+}
+#endif
+
+#if defined(HIKOCSP_HAS_UNIX_SOCKET)
+/** The maximum size of a message between client and server.
+ */
+constexpr auto max_message_size = uint32_t{16 * 1024 * 1024};
+
+/** Write a length-prefixed message to a socket.
+ */
+void write_message(int fd, std::string_view message)
+{
+    if (message.size() > max_message_size) {
+        throw std::runtime_error("Message is too large.");
+    }
+
+    auto const size = static_cast<uint32_t>(message.size());
+    auto buffer = std::string(reinterpret_cast<char const *>(&size), sizeof(size));
+    buffer += message;
+
+    for (auto todo = std::string_view{buffer}; not todo.empty();) {
+        auto const n = write(fd, todo.data(), todo.size());
+        if (n <= 0) {
+            throw std::runtime_error("Could not write to socket.");
+        }
+        todo = todo.substr(n);
+    }
+}
+
+/** Read a length-prefixed message from a socket.
+ */
+[[nodiscard]] std::string read_message(int fd)
+{
+    auto const read_exact = [fd](char *ptr, std::size_t size) {
+        while (size != 0) {
+            auto const n = read(fd, ptr, size);
+            if (n <= 0) {
+                throw std::runtime_error("Could not read from socket.");
+            }
+            ptr += n;
+            size -= n;
+        }
+    };
+
+    auto size = uint32_t{};
+    read_exact(reinterpret_cast<char *>(&size), sizeof(size));
+    if (size > max_message_size) {
+        throw std::runtime_error("Message is too large.");
+    }
+
+    auto r = std::string(size, '\0');
+    read_exact(r.data(), r.size());
+    return r;
+}
+
+/** Create a Unix domain socket address.
+ */
+[[nodiscard]] sockaddr_un make_socket_address(std::filesystem::path const& path)
+{
+    auto r = sockaddr_un{};
+    r.sun_family = AF_UNIX;
+
+    auto const str = path.string();
+    if (str.size() >= sizeof(r.sun_path)) {
+        throw std::runtime_error(std::format("Socket path {} is too long.", str));
+    }
+    std::copy(str.begin(), str.end(), r.sun_path);
+    return r;
+}
+
+/** Handle a request from a client.
+ *
+ * @param request The client's current directory followed by its arguments, each terminated by a nul.
+ * @param cache The translations kept by the server.
+ * @return The response; the exit code on the first line followed by the messages for the user.
+ */
+[[nodiscard]] std::string handle_request(std::string_view request, translation_cache& cache)
+{
+    auto strings = std::vector<std::string_view>{};
+    for (auto i = request.find('\0'); i != request.npos; i = request.find('\0')) {
+        strings.push_back(request.substr(0, i));
+        request = request.substr(i + 1);
+    }
+    if (strings.size() < 2) {
+        return "-1\nInvalid request.\n";
+    }
+
+    // Messages written to std::cerr are sent back to the client.
+    auto messages = std::ostringstream{};
+    auto const original_cerr = std::cerr.rdbuf(messages.rdbuf());
+
+    auto exit_code = 0;
+    try {
+        // Requests are handled one at a time, like running hikocsp in the client's directory.
+        std::filesystem::current_path(strings.front());
+        strings.erase(strings.begin());
+
+        options = options_type{};
+        if (auto parse_state = parse_options(strings)) {
+            print_help();
+            exit_code = parse_state == 1 ? 0 : -2;
+
+        } else if (options.server_path or options.client_path or options.watch_path) {
+            std::cerr << "--server, --client and --watch can not be used by a client.\n";
+            exit_code = -1;
+
+        } else {
+            exit_code = translate_main(&cache);
+        }
+
+    } catch (std::exception const& e) {
+        std::cerr << std::format("Could not handle request: {}.\n", e.what());
+        exit_code = -1;
+    }
+
+    std::cerr.rdbuf(original_cerr);
+    return std::format("{}\n{}", exit_code, messages.str());
+}
+
+/** Check if the peer of a socket runs as the same user as this process.
+ *
+ * A client can make the server translate templates in any directory, with the
+ * permissions of the server.
+ */
+[[nodiscard]] bool is_same_user(int fd) noexcept
+{
+#if defined(__linux__)
+    auto credentials = ucred{};
+    auto size = socklen_t{sizeof(credentials)};
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == -1) {
+        return false;
+    }
+    return credentials.uid == geteuid();
+#else
+    auto uid = uid_t{};
+    auto gid = gid_t{};
+    if (getpeereid(fd, &uid, &gid) == -1) {
+        return false;
+    }
+    return uid == geteuid();
+#endif
+}
+
+/** Translate templates on request of clients.
+ */
+[[noreturn]] void serve(std::filesystem::path const& socket_path)
+{
+    // A client that disconnects before reading the response must not kill the server.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    auto const fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        throw std::runtime_error("Could not create socket.");
+    }
+
+    auto const address = make_socket_address(socket_path);
+    // Remove the socket left behind by a previous server.
+    std::filesystem::remove(socket_path);
+
+    // Only the user running the server may connect to the socket.
+    auto const original_umask = umask(0077);
+    auto const bind_result = bind(fd, reinterpret_cast<sockaddr const *>(&address), sizeof(address));
+    umask(original_umask);
+    if (bind_result == -1) {
+        throw std::runtime_error(std::format("Could not bind socket {}.", socket_path.string()));
+    }
+    if (listen(fd, SOMAXCONN) == -1) {
+        throw std::runtime_error(std::format("Could not listen on socket {}.", socket_path.string()));
+    }
+
+    auto const verbose = options.verbose;
+    if (verbose > 0) {
+        std::cerr << std::format("Listening on {}.\n", socket_path.string());
+    }
+
+    auto cache = translation_cache{};
+    while (true) {
+        auto const client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client == -1) {
+            continue;
+        }
+
+        if (not is_same_user(client)) {
+            std::cerr << "Rejected a client of another user.\n";
+            close(client);
+            continue;
+        }
+
+        // Clients are handled one at a time, a client that stops sending must not stall the others.
+        auto const timeout = timeval{.tv_sec = 10, .tv_usec = 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        try {
+            write_message(client, handle_request(read_message(client), cache));
+        } catch (std::exception const& e) {
+            std::cerr << std::format("Could not handle request: {}.\n", e.what());
+        }
+        close(client);
+
+        if (verbose > 0) {
+            std::cerr << std::format("Cache hits {}, misses {}.\n", cache.hits(), cache.misses());
+        }
+    }
+}
+
+/** Let the server translate a template.
+ *
+ * @param socket_path The path to the server's socket.
+ * @param args The arguments of hikocsp, which are passed to the server.
+ * @return The exit code, or std::nullopt when the server is not running.
+ */
+[[nodiscard]] std::optional<int> request(std::filesystem::path const& socket_path, std::vector<std::string_view> const& args)
+{
+    auto const fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return std::nullopt;
+    }
+
+    auto const address = make_socket_address(socket_path);
+    if (connect(fd, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) == -1) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    auto message = std::filesystem::current_path().string();
+    message += '\0';
+    for (auto const& arg : args) {
+        if (not arg.starts_with("--client")) {
+            message += arg;
+            message += '\0';
+        }
+    }
+
+    auto response = std::string{};
+    try {
+        write_message(fd, message);
+        response = read_message(fd);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    auto const i = response.find('\n');
+    std::cerr << response.substr(i + 1);
+    return std::stoi(response.substr(0, i));
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    auto const args = std::vector<std::string_view>(argv, argv + argc);
+
+    if (auto parse_state = parse_options(args)) {
+        print_help();
+        return parse_state == 1 ? 0 : -2;
+    }
+
+    if (options.cache_statistics) {
+        try {
+            print_cache_statistics();
+        } catch (std::exception const& e) {
+            std::cerr << std::format("Could not read cache: {}.", e.what());
+            return -1;
+        }
+        return 0;
+    }
+
+    if (options.server_path or options.client_path) {
+#if defined(HIKOCSP_HAS_UNIX_SOCKET)
+        try {
+            if (options.server_path) {
+                serve(*options.server_path);
+            } else if (auto exit_code = request(*options.client_path, args)) {
+                return *exit_code;
+            } else if (options.verbose > 0) {
+                std::cerr << std::format("Server at {} is not running.\n", options.client_path->string());
+            }
+        } catch (std::exception const& e) {
+            std::cerr << std::format("Could not connect to server: {}.", e.what());
+            return -1;
+        }
+#else
+        std::cerr << "--server and --client are only supported on Unix.\n";
+        return -1;
+#endif
+    }
+
+    if (options.watch_path) {
+#if defined(__linux__)
+        try {
+            watch(*options.watch_path);
+        } catch (std::exception const& e) {
+            std::cerr << std::format("Could not watch templates: {}.", e.what());
+            return -1;
+        }
+#else
+        std::cerr << "--watch is only supported on Linux.\n";
+        return -1;
+#endif
+    }
+
+    return translate_main(nullptr);
 }
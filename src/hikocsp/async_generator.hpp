@@ -0,0 +1,284 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "generator.hpp"
+#include <concepts>
+#include <coroutine>
+#include <type_traits>
+#include <cassert>
+#include <exception>
+#include <utility>
+#include <memory>
+
+namespace csp { inline namespace v1 {
+
+/** A scheduler resumes coroutines on its execution context.
+ *
+ * `s.schedule()` returns an awaitable; a coroutine that awaits it is suspended
+ * and later resumed by the scheduler, for example on a thread of an executor
+ * or after a socket becomes writable.
+ */
+template<typename T>
+concept scheduler = requires(T& s) { s.schedule(); };
+
+/** A scheduler that resumes the awaiting coroutine immediately.
+ */
+class inline_scheduler {
+public:
+    [[nodiscard]] static std::suspend_never schedule() noexcept
+    {
+        return {};
+    }
+};
+
+/** A return value for an asynchronous generator-function.
+ *
+ * Unlike `csp::generator` an async-generator-function may `co_await`, for
+ * example to wait until the sink has room for more data. Awaiting a scheduler
+ * object directly, `co_await sched;`, is the same as `co_await sched.schedule();`.
+ *
+ * The consumer is a coroutine itself which awaits each value:
+ *
+ * ```
+ * while (co_await gen.next()) {
+ *     co_await socket.write(gen.value());
+ * }
+ * ```
+ *
+ * The generator-function does not run ahead of the consumer; it is only
+ * resumed from `next()`, which gives back-pressure without buffering. Control
+ * is transferred symmetrically between the consumer and the generator-function.
+ *
+ * The coroutine-frame is allocated in the same way as for `csp::generator`,
+ * optionally with an allocator passed after `std::allocator_arg`.
+ */
+template<typename T>
+class async_generator {
+public:
+    using value_type = T;
+
+    static_assert(not std::is_reference_v<value_type>);
+    static_assert(not std::is_const_v<value_type>);
+
+    class promise_type;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    class promise_type : public detail::generator_promise_allocation {
+    public:
+        async_generator get_return_object()
+        {
+            return async_generator{handle_type::from_promise(*this)};
+        }
+
+        value_type& value() const noexcept
+        {
+            assert(_value_ptr != nullptr);
+            return *_value_ptr;
+        }
+
+        static std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        static auto final_suspend() noexcept
+        {
+            return yield_awaiter{};
+        }
+
+        /** Yield an rvalue.
+         *
+         * The consumer may move the value out of the generator.
+         */
+        auto yield_value(value_type&& arg) noexcept
+        {
+            _value_ptr = std::addressof(arg);
+            return yield_awaiter{};
+        }
+
+        /** Yield an lvalue, a copy is stored in the coroutine-frame.
+         */
+        auto yield_value(value_type const& arg) noexcept(std::is_nothrow_copy_constructible_v<value_type>)
+        {
+            return converted_awaiter{arg};
+        }
+
+        /** Yield a value which is only explicitly convertible to value_type.
+         */
+        template<typename Arg>
+            requires(std::constructible_from<value_type, Arg> and not std::convertible_to<Arg, value_type const&>)
+        auto yield_value(Arg&& arg) noexcept(std::is_nothrow_constructible_v<value_type, Arg>)
+        {
+            return converted_awaiter{value_type(std::forward<Arg>(arg))};
+        }
+
+        void return_void() noexcept {}
+
+        template<typename Awaitable>
+        decltype(auto) await_transform(Awaitable&& awaitable) noexcept
+        {
+            return std::forward<Awaitable>(awaitable);
+        }
+
+        /** Awaiting a scheduler, reschedules on the scheduler.
+         */
+        template<typename Scheduler>
+            requires scheduler<Scheduler>
+        decltype(auto) await_transform(Scheduler& s)
+        {
+            return s.schedule();
+        }
+
+        void unhandled_exception() noexcept
+        {
+            _value_ptr = nullptr;
+            _exception = std::current_exception();
+        }
+
+        void rethrow()
+        {
+            if (auto ptr = _exception) {
+                _exception = nullptr;
+                std::rethrow_exception(ptr);
+            }
+        }
+
+    private:
+        /** Suspend the generator-function and continue the consumer.
+         */
+        struct yield_awaiter {
+            [[nodiscard]] bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(handle_type handle) noexcept
+            {
+                return handle.promise()._consumer;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        struct converted_awaiter {
+            value_type value;
+
+            [[nodiscard]] bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(handle_type handle) noexcept
+            {
+                auto& promise = handle.promise();
+                promise._value_ptr = std::addressof(value);
+                return promise._consumer;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        std::exception_ptr _exception = nullptr;
+        value_type *_value_ptr = nullptr;
+
+        /** The coroutine awaiting next().
+         */
+        std::coroutine_handle<> _consumer = nullptr;
+
+        friend class async_generator;
+    };
+
+    /** The awaitable returned by next().
+     */
+    class next_awaiter {
+    public:
+        explicit next_awaiter(handle_type coroutine) noexcept : _coroutine(coroutine) {}
+
+        [[nodiscard]] bool await_ready() const noexcept
+        {
+            return not _coroutine or _coroutine.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept
+        {
+            auto& promise = _coroutine.promise();
+            promise._consumer = consumer;
+            promise._value_ptr = nullptr;
+            return _coroutine;
+        }
+
+        /** Get the result of the next value.
+         *
+         * @retval true A new value is available through `async_generator::value()`.
+         * @retval false The generator-function has finished.
+         * @throws The exception thrown by the generator-function.
+         */
+        bool await_resume()
+        {
+            if (not _coroutine) {
+                return false;
+            }
+
+            _coroutine.promise().rethrow();
+            return not _coroutine.done();
+        }
+
+    private:
+        handle_type _coroutine;
+    };
+
+    async_generator() noexcept = default;
+
+    explicit async_generator(handle_type coroutine) noexcept : _coroutine(coroutine) {}
+
+    ~async_generator()
+    {
+        if (_coroutine) {
+            _coroutine.destroy();
+        }
+    }
+
+    async_generator(async_generator const&) = delete;
+    async_generator& operator=(async_generator const&) = delete;
+
+    async_generator(async_generator&& other) noexcept : _coroutine(std::exchange(other._coroutine, {})) {}
+
+    async_generator& operator=(async_generator&& other) noexcept
+    {
+        if (this != &other) {
+            if (_coroutine) {
+                _coroutine.destroy();
+            }
+            _coroutine = std::exchange(other._coroutine, {});
+        }
+        return *this;
+    }
+
+    /** Resume the generator-function until it yields the next value.
+     *
+     * Must be awaited from a coroutine; `co_await gen.next()` returns false
+     * when the generator-function has finished.
+     */
+    [[nodiscard]] next_awaiter next() noexcept
+    {
+        return next_awaiter{_coroutine};
+    }
+
+    /** The value yielded by the generator-function.
+     *
+     * Only valid after `co_await next()` returned true.
+     */
+    [[nodiscard]] value_type& value() const noexcept
+    {
+        assert(_coroutine);
+        return _coroutine.promise().value();
+    }
+
+private:
+    handle_type _coroutine = nullptr;
+};
+
+}} // namespace csp::v1
@@ -0,0 +1,243 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "async_generator.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdexcept>
+#include <coroutine>
+#include <exception>
+
+namespace async_generator_tests {
+
+/** A minimal eagerly started coroutine to consume async-generators.
+ */
+class task {
+public:
+    struct promise_type {
+        task get_return_object() noexcept
+        {
+            return task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        static std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        static std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept
+        {
+            exception = std::current_exception();
+        }
+
+        std::exception_ptr exception = nullptr;
+    };
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) {}
+
+    ~task()
+    {
+        _handle.destroy();
+    }
+
+    task(task const&) = delete;
+    task& operator=(task const&) = delete;
+
+    [[nodiscard]] bool done() const noexcept
+    {
+        return _handle.done();
+    }
+
+    void rethrow() const
+    {
+        if (auto ptr = _handle.promise().exception) {
+            std::rethrow_exception(ptr);
+        }
+    }
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+};
+
+/** A scheduler which queues coroutines until run() is called.
+ */
+class queue_scheduler {
+public:
+    struct awaiter {
+        queue_scheduler& self;
+
+        [[nodiscard]] bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            self._queue.push_back(handle);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    [[nodiscard]] awaiter schedule() noexcept
+    {
+        return awaiter{*this};
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _queue.empty();
+    }
+
+    void run_one()
+    {
+        auto handle = _queue.front();
+        _queue.pop_front();
+        handle.resume();
+    }
+
+private:
+    std::deque<std::coroutine_handle<>> _queue;
+};
+
+static_assert(csp::scheduler<queue_scheduler>);
+static_assert(csp::scheduler<csp::inline_scheduler>);
+static_assert(not csp::scheduler<int>);
+
+csp::async_generator<std::string> my_generator()
+{
+    co_yield "Hello";
+    co_yield std::string{" "};
+    auto world = std::string{"World"};
+    co_yield world;
+}
+
+csp::async_generator<std::string> scheduling_generator(queue_scheduler& scheduler)
+{
+    co_yield "a";
+    co_await scheduler;
+    co_yield "b";
+    co_await scheduler.schedule();
+    co_yield "c";
+}
+
+csp::async_generator<int> throwing_generator()
+{
+    co_yield 1;
+    throw std::runtime_error("throwing_generator");
+}
+
+csp::async_generator<int> inline_generator(csp::inline_scheduler scheduler)
+{
+    for (auto i = 0; i != 3; ++i) {
+        co_await scheduler;
+        co_yield i;
+    }
+}
+
+// The loops below are written without `co_await` in the while-condition, which
+// is miscompiled by GCC 12.
+task consume(csp::async_generator<std::string>& gen, std::string& out)
+{
+    while (true) {
+        auto const has_value = co_await gen.next();
+        if (not has_value) {
+            co_return;
+        }
+        out += std::move(gen.value());
+    }
+}
+
+template<typename T>
+task consume_into(csp::async_generator<T>& gen, std::vector<T>& out)
+{
+    while (true) {
+        auto const has_value = co_await gen.next();
+        if (not has_value) {
+            co_return;
+        }
+        out.push_back(gen.value());
+    }
+}
+
+} // namespace async_generator_tests
+
+TEST(async_generator, simple)
+{
+    auto gen = async_generator_tests::my_generator();
+    auto out = std::string{};
+    auto t = async_generator_tests::consume(gen, out);
+    ASSERT_TRUE(t.done());
+    t.rethrow();
+    ASSERT_EQ(out, "Hello World");
+}
+
+TEST(async_generator, lazy_start)
+{
+    auto scheduler = async_generator_tests::queue_scheduler{};
+    auto gen = async_generator_tests::scheduling_generator(scheduler);
+    ASSERT_TRUE(scheduler.empty());
+}
+
+TEST(async_generator, scheduler)
+{
+    auto scheduler = async_generator_tests::queue_scheduler{};
+    auto gen = async_generator_tests::scheduling_generator(scheduler);
+    auto out = std::string{};
+    auto t = async_generator_tests::consume(gen, out);
+
+    // The consumer is suspended while the generator-function waits on the scheduler.
+    ASSERT_FALSE(t.done());
+    ASSERT_EQ(out, "a");
+
+    ASSERT_FALSE(scheduler.empty());
+    scheduler.run_one();
+    ASSERT_FALSE(t.done());
+    ASSERT_EQ(out, "ab");
+
+    ASSERT_FALSE(scheduler.empty());
+    scheduler.run_one();
+    ASSERT_TRUE(scheduler.empty());
+    ASSERT_TRUE(t.done());
+    t.rethrow();
+    ASSERT_EQ(out, "abc");
+}
+
+TEST(async_generator, inline_scheduler)
+{
+    auto gen = async_generator_tests::inline_generator({});
+    auto out = std::vector<int>{};
+    auto t = async_generator_tests::consume_into(gen, out);
+    ASSERT_TRUE(t.done());
+    t.rethrow();
+    ASSERT_EQ(out, (std::vector<int>{0, 1, 2}));
+}
+
+TEST(async_generator, exception)
+{
+    auto gen = async_generator_tests::throwing_generator();
+    auto out = std::vector<int>{};
+    auto t = async_generator_tests::consume_into(gen, out);
+    ASSERT_TRUE(t.done());
+    ASSERT_THROW(t.rethrow(), std::runtime_error);
+    ASSERT_EQ(out, (std::vector<int>{1}));
+}
+
+TEST(async_generator, empty)
+{
+    auto gen = csp::async_generator<int>{};
+    auto out = std::vector<int>{};
+    auto t = async_generator_tests::consume_into(gen, out);
+    ASSERT_TRUE(t.done());
+    ASSERT_TRUE(out.empty());
+}
@@ -5,6 +5,9 @@
 #pragma once
 
 #include <stdexcept>
+#include <filesystem>
+#include <string>
+#include <format>
 
 namespace csp { inline namespace v1 {
 
@@ -12,4 +15,26 @@ class csp_error : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+/** An error found in a template.
+ */
+struct csp_diagnostic {
+    std::filesystem::path path;
+    int line_nr = 0;
+
+    /** The column of the error in the line, starting at 1.
+     */
+    int column_nr = 0;
+
+    std::string message;
+
+    [[nodiscard]] friend bool operator==(csp_diagnostic const&, csp_diagnostic const&) = default;
+
+    /** Format the diagnostic like a compiler error: "path:line:column: message".
+     */
+    [[nodiscard]] friend std::string to_string(csp_diagnostic const& rhs)
+    {
+        return std::format("{}:{}:{}: {}", rhs.path.string(), rhs.line_nr, rhs.column_nr, rhs.message);
+    }
+};
+
 }}
@@ -0,0 +1,970 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "csp_parser.hpp"
+#include "csp_error.hpp"
+#include "csp_token.hpp"
+#include <string_view>
+#include <string>
+#include <vector>
+#include <map>
+#include <variant>
+#include <functional>
+#include <format>
+#include <filesystem>
+#include <optional>
+#include <concepts>
+#include <ranges>
+#include <algorithm>
+#include <span>
+#include <tuple>
+#include <charconv>
+#include <system_error>
+#include <cstdint>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+/** A value of a variable used by an interpreted template.
+ *
+ * Formatting a value gives the same result as formatting the held alternative,
+ * so that an interpreted template produces the same output as the translated
+ * template.
+ */
+class csp_value {
+public:
+    using list_type = std::vector<csp_value>;
+    using variant_type = std::variant<std::monostate, bool, long long, double, std::string, list_type>;
+
+    csp_value() noexcept = default;
+    csp_value(csp_value const&) = default;
+    csp_value(csp_value&&) noexcept = default;
+    csp_value& operator=(csp_value const&) = default;
+    csp_value& operator=(csp_value&&) noexcept = default;
+
+    csp_value(bool value) noexcept : _v(value) {}
+
+    template<std::integral T>
+        requires(not std::same_as<T, bool>)
+    csp_value(T value) noexcept : _v(static_cast<long long>(value))
+    {
+    }
+
+    template<std::floating_point T>
+    csp_value(T value) noexcept : _v(static_cast<double>(value))
+    {
+    }
+
+    csp_value(std::string value) noexcept : _v(std::move(value)) {}
+    csp_value(std::string_view value) : _v(std::string{value}) {}
+    csp_value(char const *value) : _v(std::string{value}) {}
+
+    csp_value(list_type value) noexcept : _v(std::move(value)) {}
+
+    /** Construct a list from a range of values.
+     */
+    template<std::ranges::input_range Range>
+        requires(std::constructible_from<csp_value, std::ranges::range_reference_t<Range>> and
+                 not std::convertible_to<Range, std::string_view>)
+    csp_value(Range const& range) : _v(list_type{})
+    {
+        auto& list = std::get<list_type>(_v);
+        for (auto const& item : range) {
+            list.emplace_back(item);
+        }
+    }
+
+    [[nodiscard]] variant_type const& variant() const noexcept
+    {
+        return _v;
+    }
+
+    /** Get the list, or nullptr if this value is not a list.
+     */
+    [[nodiscard]] list_type const *list() const noexcept
+    {
+        return std::get_if<list_type>(&_v);
+    }
+
+    /** Convert to a condition of an if-statement.
+     *
+     * @return The value of a bool or integer, or std::nullopt for other types.
+     */
+    [[nodiscard]] std::optional<bool> condition() const noexcept
+    {
+        if (auto ptr = std::get_if<bool>(&_v)) {
+            return *ptr;
+        } else if (auto ptr = std::get_if<long long>(&_v)) {
+            return *ptr != 0;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+private:
+    variant_type _v;
+};
+
+/** The variables passed to an interpreted template, by name.
+ */
+using csp_variables = std::map<std::string, csp_value, std::less<>>;
+
+/** The filters that may be used by an interpreted template, by their expression.
+ *
+ * Like in a translated template a filter is called with a std::string
+ * and returns a std::string.
+ */
+using csp_filters = std::map<std::string, std::function<std::string(std::string)>, std::less<>>;
+
+}} // namespace csp::v1
+
+template<>
+struct std::formatter<csp::csp_value, char> {
+    std::string_view spec;
+
+    constexpr auto parse(std::format_parse_context& ctx)
+    {
+        auto it = ctx.begin();
+        while (it != ctx.end() and *it != '}') {
+            if (*it == '{') {
+                throw std::format_error("Nested replacement fields are not supported for csp::csp_value.");
+            }
+            ++it;
+        }
+        spec = std::string_view{ctx.begin(), it};
+        return it;
+    }
+
+    auto format(csp::csp_value const& value, std::format_context& ctx) const
+    {
+        auto const fmt = std::format("{{:{}}}", spec);
+
+        return std::visit(
+            [&](auto const& x) -> std::format_context::iterator {
+                using type = std::remove_cvref_t<decltype(x)>;
+                if constexpr (std::same_as<type, std::monostate>) {
+                    throw std::format_error("Can not format an empty csp::csp_value.");
+                } else if constexpr (std::same_as<type, csp::csp_value::list_type>) {
+                    throw std::format_error("Can not format a list csp::csp_value.");
+                } else {
+                    return std::vformat_to(ctx.out(), fmt, std::make_format_args(x));
+                }
+            },
+            value.variant());
+    }
+};
+
+namespace csp { inline namespace v1 {
+namespace detail {
+
+enum class csp_opcode : uint8_t {
+    /** Output text; a = offset, b = size. */
+    text,
+    /** Output a formatted placeholder; a = index of the format. */
+    format,
+    /** a = target */
+    jump,
+    /** a = slot of the condition, b = target */
+    jump_if_false,
+    /** a = slot of the condition, b = target */
+    jump_if_true,
+    /** Start a for-loop; a = index of the loop, b = target after the loop. */
+    loop_start,
+    /** Next iteration of a for-loop; a = index of the loop, b = target of the loop body. */
+    loop_next
+};
+
+struct csp_instruction {
+    csp_opcode op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+};
+
+struct csp_format {
+    std::string format;
+    std::vector<uint32_t> arguments;
+    std::vector<uint32_t> filters;
+    std::string path;
+    int line_nr;
+};
+
+struct csp_loop {
+    uint32_t list;
+    uint32_t variable;
+    std::string path;
+    int line_nr;
+};
+
+enum class csp_slot_type : uint8_t {
+    /** A variable passed to render(). */
+    variable,
+    /** The variable of a for-loop. */
+    loop_variable,
+    /** A literal in the template. */
+    constant
+};
+
+struct csp_slot {
+    std::string name;
+    csp_slot_type type;
+    std::string path;
+    int line_nr;
+    csp_value value = {};
+};
+
+/** Decode a C++ string-literal.
+ *
+ * @return The decoded string, or std::nullopt when @a str is not a simple string-literal.
+ */
+[[nodiscard]] constexpr std::optional<std::string> decode_string_literal(std::string_view str) noexcept
+{
+    if (str.size() < 2 or str.front() != '"' or str.back() != '"') {
+        return std::nullopt;
+    }
+    str = str.substr(1, str.size() - 2);
+
+    auto r = std::string{};
+    for (auto it = str.begin(); it != str.end(); ++it) {
+        if (*it == '"') {
+            return std::nullopt;
+        } else if (*it != '\\') {
+            r += *it;
+            continue;
+        }
+
+        if (++it == str.end()) {
+            return std::nullopt;
+        }
+
+        switch (*it) {
+        case 'n': r += '\n'; break;
+        case 't': r += '\t'; break;
+        case 'r': r += '\r'; break;
+        case 'a': r += '\a'; break;
+        case 'b': r += '\b'; break;
+        case 'f': r += '\f'; break;
+        case 'v': r += '\v'; break;
+        case '\\': r += '\\'; break;
+        case '\'': r += '\''; break;
+        case '"': r += '"'; break;
+        case '?': r += '?'; break;
+        case 'x':
+            {
+                auto c = 0;
+                auto num_digits = 0;
+                for (; it + 1 != str.end(); ++num_digits) {
+                    auto const d = *(it + 1);
+                    if (d >= '0' and d <= '9') {
+                        c = c * 16 + (d - '0');
+                    } else if (d >= 'a' and d <= 'f') {
+                        c = c * 16 + (d - 'a' + 10);
+                    } else if (d >= 'A' and d <= 'F') {
+                        c = c * 16 + (d - 'A' + 10);
+                    } else {
+                        break;
+                    }
+                    ++it;
+                }
+                if (num_digits == 0 or c > 0xff) {
+                    return std::nullopt;
+                }
+                r += static_cast<char>(c);
+            }
+            break;
+        default:
+            if (*it >= '0' and *it <= '7') {
+                auto c = *it - '0';
+                for (auto i = 0; i != 2 and it + 1 != str.end() and *(it + 1) >= '0' and *(it + 1) <= '7'; ++i) {
+                    c = c * 8 + (*++it - '0');
+                }
+                if (c > 0xff) {
+                    return std::nullopt;
+                }
+                r += static_cast<char>(c);
+            } else {
+                return std::nullopt;
+            }
+        }
+    }
+    return r;
+}
+
+[[nodiscard]] constexpr bool is_csp_identifier_char(char c, bool first) noexcept
+{
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or c == '_' or (not first and c >= '0' and c <= '9');
+}
+
+/** Lexer for the subset of C++ allowed in the verbatim parts of an interpreted template.
+ */
+class csp_interpreter_lexer {
+public:
+    constexpr csp_interpreter_lexer(std::string_view text) noexcept : _text(text) {}
+
+    /** Get the next token, an identifier or a single punctuation character.
+     *
+     * @return The token, or an empty string at the end of the text.
+     */
+    [[nodiscard]] constexpr std::string_view next() noexcept
+    {
+        while (_i != _text.size() and
+               (_text[_i] == ' ' or _text[_i] == '\t' or _text[_i] == '\n' or _text[_i] == '\r')) {
+            ++_i;
+        }
+
+        auto const first = _i;
+        if (_i == _text.size()) {
+            return {};
+        } else if (is_csp_identifier_char(_text[_i], true)) {
+            while (_i != _text.size() and is_csp_identifier_char(_text[_i], false)) {
+                ++_i;
+            }
+        } else if (_text.substr(_i, 2) == "&&") {
+            _i += 2;
+        } else {
+            ++_i;
+        }
+        return _text.substr(first, _i - first);
+    }
+
+    [[nodiscard]] constexpr std::string_view peek() noexcept
+    {
+        auto const i = _i;
+        auto const r = next();
+        _i = i;
+        return r;
+    }
+
+private:
+    std::string_view _text;
+    std::size_t _i = 0;
+};
+
+} // namespace detail
+
+/** A template compiled for the interpreter.
+ *
+ * The interpreter supports a subset of the template language: text,
+ * placeholders whose expressions are variable names, filters which are found
+ * by name in a `csp_filters` map, and the following C++ in verbatim code:
+ *
+ *  - `for (auto x : name) {`, optionally with `const`, `&` or `&&`,
+ *  - `if (name) {`, `if (not name) {` or `if (!name) {`,
+ *  - `} else if (name) {`, `} else {`,
+ *  - `}`.
+ *
+ * A template using only this subset produces the same output as when it is
+ * translated into C++ and `@include`-ed.
+ */
+class csp_program {
+public:
+    csp_program() noexcept = default;
+    csp_program(csp_program const&) = default;
+    csp_program(csp_program&&) noexcept = default;
+    csp_program& operator=(csp_program const&) = default;
+    csp_program& operator=(csp_program&&) noexcept = default;
+
+    /** Compile the template from a token stream.
+     *
+     * @param first An iterator to the first token.
+     * @param last A sentinel beyond the last token.
+     * @param path The path of the template, used for error messages.
+     * @param filters The filters that the template may use.
+     * @throws csp_error When the template uses more than the supported subset.
+     */
+    template<std::input_iterator It, std::sentinel_for<It> ItEnd>
+    csp_program(It first, ItEnd last, std::filesystem::path path, csp_filters const& filters);
+
+    /** Render the template.
+     *
+     * @param variables The variables referenced by the template.
+     * @param sink A callback function which is called with each piece of text.
+     * @throws csp_error When a variable is missing or has the wrong type.
+     * @throws std::format_error When formatting a placeholder failed.
+     */
+    template<typename Callback>
+    void render(csp_variables const& variables, Callback const& sink) const
+    {
+        auto slots = std::vector<csp_value const *>(_slots.size(), nullptr);
+        for (auto i = std::size_t{0}; i != _slots.size(); ++i) {
+            auto const& slot = _slots[i];
+            if (slot.type == detail::csp_slot_type::constant) {
+                slots[i] = &slot.value;
+                continue;
+            } else if (slot.type == detail::csp_slot_type::loop_variable) {
+                continue;
+            }
+
+            auto it = variables.find(slot.name);
+            if (it == variables.end()) {
+                throw csp_error(std::format("{}:{}: Unknown variable {}.", slot.path, slot.line_nr, slot.name));
+            }
+            slots[i] = &it->second;
+        }
+
+        auto loop_indices = std::vector<std::size_t>(_loops.size(), 0);
+
+        auto const condition = [&](uint32_t slot) {
+            if (auto r = slots[slot]->condition()) {
+                return *r;
+            }
+            throw csp_error(std::format(
+                "{}:{}: Condition {} is not a bool or integer.", _slots[slot].path, _slots[slot].line_nr, _slots[slot].name));
+        };
+
+        auto const list = [&](detail::csp_loop const& loop) -> auto const& {
+            if (auto r = slots[loop.list]->list()) {
+                return *r;
+            }
+            throw csp_error(std::format("{}:{}: {} is not a list.", loop.path, loop.line_nr, _slots[loop.list].name));
+        };
+
+        auto pc = std::size_t{0};
+        while (pc != _code.size()) {
+            auto const& instruction = _code[pc++];
+
+            switch (instruction.op) {
+            case detail::csp_opcode::text:
+                sink(std::string_view{_text.data() + instruction.a, instruction.b});
+                break;
+
+            case detail::csp_opcode::format:
+                sink(format(_formats[instruction.a], slots));
+                break;
+
+            case detail::csp_opcode::jump:
+                pc = instruction.a;
+                break;
+
+            case detail::csp_opcode::jump_if_false:
+                if (not condition(instruction.a)) {
+                    pc = instruction.b;
+                }
+                break;
+
+            case detail::csp_opcode::jump_if_true:
+                if (condition(instruction.a)) {
+                    pc = instruction.b;
+                }
+                break;
+
+            case detail::csp_opcode::loop_start:
+                {
+                    auto const& loop = _loops[instruction.a];
+                    auto const& items = list(loop);
+                    if (items.empty()) {
+                        pc = instruction.b;
+                    } else {
+                        loop_indices[instruction.a] = 0;
+                        slots[loop.variable] = &items.front();
+                    }
+                }
+                break;
+
+            case detail::csp_opcode::loop_next:
+                {
+                    auto const& loop = _loops[instruction.a];
+                    auto const& items = list(loop);
+                    auto const i = ++loop_indices[instruction.a];
+                    if (i < items.size()) {
+                        slots[loop.variable] = &items[i];
+                        pc = instruction.b;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    /** Render the template into a string.
+     */
+    [[nodiscard]] std::string render(csp_variables const& variables) const
+    {
+        auto r = std::string{};
+        render(variables, [&r](std::string_view str) {
+            r += str;
+        });
+        return r;
+    }
+
+private:
+    std::filesystem::path _path;
+    std::string _text;
+    std::vector<detail::csp_instruction> _code;
+    std::vector<detail::csp_format> _formats;
+    std::vector<std::function<std::string(std::string)>> _filters;
+    std::vector<detail::csp_slot> _slots;
+    std::vector<detail::csp_loop> _loops;
+
+    class program_compiler;
+
+    [[nodiscard]] std::string format(detail::csp_format const& fmt, std::vector<csp_value const *> const& slots) const
+    {
+        auto const& args = fmt.arguments;
+
+        auto r = std::string{};
+        switch (args.size()) {
+        case 1:
+            r = std::vformat(fmt.format, std::make_format_args(*slots[args[0]]));
+            break;
+        case 2:
+            r = std::vformat(fmt.format, std::make_format_args(*slots[args[0]], *slots[args[1]]));
+            break;
+        case 3:
+            r = std::vformat(fmt.format, std::make_format_args(*slots[args[0]], *slots[args[1]], *slots[args[2]]));
+            break;
+        case 4:
+            r = std::vformat(
+                fmt.format, std::make_format_args(*slots[args[0]], *slots[args[1]], *slots[args[2]], *slots[args[3]]));
+            break;
+        default:
+            throw csp_error(std::format("{}:{}: Too many arguments to format.", fmt.path, fmt.line_nr));
+        }
+
+        for (auto filter : fmt.filters) {
+            r = _filters[filter](std::move(r));
+        }
+        return r;
+    }
+};
+
+/** Compiles a token stream into a csp_program.
+ */
+class csp_program::program_compiler {
+public:
+    program_compiler(csp_program& program, csp_filters const& filters) noexcept :
+        _program(program), _available_filters(filters), _path(program._path.string())
+    {
+    }
+
+    template<typename Token>
+    void add(Token const& token)
+    {
+        if (token.kind == csp_token_type::text) {
+            add_text(token.text);
+
+        } else if (token.kind == csp_token_type::verbatim) {
+            add_verbatim(token.text, token.line_nr);
+
+        } else if (token.kind == csp_token_type::path) {
+            _path = token.text;
+
+        } else if (token.kind == csp_token_type::cache or token.kind == csp_token_type::end) {
+            // An interpreted template is rendered on each call, the region is rendered without caching.
+
+        } else if (token.kind == csp_token_type::flush) {
+            // The rendered template is returned at once.
+
+        } else if (token.kind == csp_token_type::parallel or token.kind == csp_token_type::section) {
+            // The sections are rendered one after the other, in order.
+
+        } else if (token.kind == csp_token_type::placeholder_argument) {
+            _arguments.push_back(std::string{token.text});
+
+        } else if (token.kind == csp_token_type::placeholder_filter) {
+            _placeholder_filters.push_back(std::string{token.text});
+
+        } else if (token.kind == csp_token_type::placeholder_end) {
+            add_placeholder(token.line_nr);
+
+        } else {
+            throw csp_error(std::format("{}:{}: Unsupported token in interpreted template.", _path, token.line_nr));
+        }
+    }
+
+    void finish()
+    {
+        if (not _blocks.empty()) {
+            throw csp_error(std::format("{}:{}: Missing '}}' at end of template.", _path, _blocks.back().line_nr));
+        }
+    }
+
+private:
+    enum class block_type : uint8_t { loop, condition };
+
+    struct block {
+        block_type type;
+        int line_nr;
+
+        /** The conditional jump to patch when the condition is false, or the loop-start instruction. */
+        std::optional<std::size_t> patch;
+
+        /** Jumps to the end of an if/else chain. */
+        std::vector<std::size_t> end_patches = {};
+
+        /** The index of the loop. */
+        uint32_t loop = 0;
+
+        /** The first instruction of the loop body. */
+        uint32_t body = 0;
+
+        /** The number of loop-variables in scope when this block started. */
+        std::size_t num_scope = 0;
+    };
+
+    csp_program& _program;
+    csp_filters const& _available_filters;
+    std::string _path;
+
+    std::vector<std::string> _arguments;
+    std::vector<std::string> _placeholder_filters;
+    std::vector<uint32_t> _default_filters;
+    std::vector<block> _blocks;
+
+    /** The loop-variables in scope, innermost last. */
+    std::vector<std::pair<std::string, uint32_t>> _scope;
+
+    [[nodiscard]] uint32_t pc() const noexcept
+    {
+        return static_cast<uint32_t>(_program._code.size());
+    }
+
+    void emit(detail::csp_opcode op, uint32_t a = 0, uint32_t b = 0)
+    {
+        _program._code.push_back({op, a, b});
+    }
+
+    void add_text(std::string_view text)
+    {
+        if (text.empty()) {
+            return;
+        }
+
+        auto const offset = static_cast<uint32_t>(_program._text.size());
+        _program._text += text;
+        emit(detail::csp_opcode::text, offset, static_cast<uint32_t>(text.size()));
+    }
+
+    [[nodiscard]] static std::string_view trim(std::string_view str) noexcept
+    {
+        auto const first = str.find_first_not_of(" \t\r\n");
+        if (first == str.npos) {
+            return {};
+        }
+        auto const last = str.find_last_not_of(" \t\r\n");
+        return str.substr(first, last - first + 1);
+    }
+
+    [[nodiscard]] static bool is_identifier(std::string_view str) noexcept
+    {
+        if (str.empty() or not detail::is_csp_identifier_char(str.front(), true)) {
+            return false;
+        }
+        return std::ranges::all_of(str, [](char c) {
+            return detail::is_csp_identifier_char(c, false);
+        });
+    }
+
+    /** Find or create the slot for a variable.
+     */
+    [[nodiscard]] uint32_t variable(std::string_view name, int line_nr)
+    {
+        if (not is_identifier(name)) {
+            throw csp_error(std::format("{}:{}: Expecting a variable name, found '{}'.", _path, line_nr, name));
+        }
+
+        for (auto it = _scope.rbegin(); it != _scope.rend(); ++it) {
+            if (it->first == name) {
+                return it->second;
+            }
+        }
+
+        auto& slots = _program._slots;
+        for (auto i = std::size_t{0}; i != slots.size(); ++i) {
+            if (slots[i].type == detail::csp_slot_type::variable and slots[i].name == name) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+
+        slots.push_back({std::string{name}, detail::csp_slot_type::variable, _path, line_nr});
+        return static_cast<uint32_t>(slots.size() - 1);
+    }
+
+    /** Find or create the slot for an argument of a placeholder.
+     *
+     * An argument is a variable, a string-literal or an integer-literal.
+     */
+    [[nodiscard]] uint32_t argument(std::string_view expression, int line_nr)
+    {
+        auto value = csp_value{};
+        if (expression.starts_with('"')) {
+            auto str = detail::decode_string_literal(expression);
+            if (not str) {
+                throw csp_error(std::format("{}:{}: Unsupported string-literal {}.", _path, line_nr, expression));
+            }
+            value = std::move(*str);
+
+        } else if (not expression.empty() and ((expression.front() >= '0' and expression.front() <= '9') or expression.front() == '-')) {
+            auto integer = 0LL;
+            auto const [ptr, ec] = std::from_chars(expression.data(), expression.data() + expression.size(), integer);
+            if (ec != std::errc{} or ptr != expression.data() + expression.size()) {
+                throw csp_error(std::format("{}:{}: Unsupported integer-literal {}.", _path, line_nr, expression));
+            }
+            value = integer;
+
+        } else {
+            return variable(expression, line_nr);
+        }
+
+        auto& slots = _program._slots;
+        slots.push_back({std::string{expression}, detail::csp_slot_type::constant, _path, line_nr, std::move(value)});
+        return static_cast<uint32_t>(slots.size() - 1);
+    }
+
+    [[nodiscard]] uint32_t filter(std::string_view expression, int line_nr)
+    {
+        auto const name = trim(expression);
+        auto it = _available_filters.find(name);
+        if (it == _available_filters.end()) {
+            throw csp_error(std::format("{}:{}: Unknown filter '{}'.", _path, line_nr, name));
+        }
+
+        _program._filters.push_back(it->second);
+        return static_cast<uint32_t>(_program._filters.size() - 1);
+    }
+
+    /** Compile a placeholder, in the same way as translate_csp().
+     */
+    void add_placeholder(int line_nr)
+    {
+        auto filters = std::vector<uint32_t>{};
+        for (auto const& expression : _placeholder_filters) {
+            // An empty filter is the identity function.
+            if (not expression.empty()) {
+                filters.push_back(filter(expression, line_nr));
+            }
+        }
+
+        if (_arguments.empty()) {
+            if (not _placeholder_filters.empty()) {
+                _default_filters = std::move(filters);
+            }
+
+        } else if (
+            _placeholder_filters.empty() and _arguments.size() == 1 and _arguments.front().starts_with('"') and
+            _arguments.front().ends_with('"')) {
+            // Escape.
+            auto const text = detail::decode_string_literal(_arguments.front());
+            if (not text) {
+                throw csp_error(std::format("{}:{}: Unsupported string-literal {}.", _path, line_nr, _arguments.front()));
+            }
+            add_text(*text);
+
+        } else {
+            if (_placeholder_filters.empty()) {
+                filters = _default_filters;
+            }
+
+            auto fmt = detail::csp_format{"{}", {}, std::move(filters), _path, line_nr};
+
+            auto arguments = std::span{_arguments};
+            if (arguments.size() > 1) {
+                auto const format_string = detail::decode_string_literal(trim(arguments.front()));
+                if (not format_string) {
+                    throw csp_error(
+                        std::format("{}:{}: Expecting a format-string, found '{}'.", _path, line_nr, arguments.front()));
+                }
+                fmt.format = *format_string;
+                arguments = arguments.subspan(1);
+            }
+
+            if (arguments.size() > 4) {
+                throw csp_error(std::format("{}:{}: Too many arguments to format.", _path, line_nr));
+            }
+
+            for (auto const& expression : arguments) {
+                fmt.arguments.push_back(argument(trim(expression), line_nr));
+            }
+
+            _program._formats.push_back(std::move(fmt));
+            emit(detail::csp_opcode::format, static_cast<uint32_t>(_program._formats.size() - 1));
+        }
+
+        _arguments.clear();
+        _placeholder_filters.clear();
+    }
+
+    void expect(detail::csp_interpreter_lexer& lexer, std::string_view expected, int line_nr)
+    {
+        if (auto const token = lexer.next(); token != expected) {
+            throw csp_error(std::format("{}:{}: Expecting '{}', found '{}'.", _path, line_nr, expected, token));
+        }
+    }
+
+    /** Compile the condition of an if-statement, including the open brace.
+     *
+     * @return The index of the conditional jump instruction to patch.
+     */
+    [[nodiscard]] std::size_t add_condition(detail::csp_interpreter_lexer& lexer, int line_nr)
+    {
+        expect(lexer, "(", line_nr);
+
+        auto op = detail::csp_opcode::jump_if_false;
+        if (lexer.peek() == "not" or lexer.peek() == "!") {
+            std::ignore = lexer.next();
+            op = detail::csp_opcode::jump_if_true;
+        }
+
+        auto const slot = variable(lexer.next(), line_nr);
+        expect(lexer, ")", line_nr);
+        expect(lexer, "{", line_nr);
+
+        auto const r = _program._code.size();
+        emit(op, slot);
+        return r;
+    }
+
+    /** Set the target of a jump instruction to the current position.
+     */
+    void patch(std::size_t instruction) noexcept
+    {
+        auto& code = _program._code[instruction];
+        if (code.op == detail::csp_opcode::jump) {
+            code.a = pc();
+        } else {
+            code.b = pc();
+        }
+    }
+
+    void add_for(detail::csp_interpreter_lexer& lexer, int line_nr)
+    {
+        expect(lexer, "(", line_nr);
+        expect(lexer, "auto", line_nr);
+        if (lexer.peek() == "const") {
+            std::ignore = lexer.next();
+        }
+        if (lexer.peek() == "&" or lexer.peek() == "&&") {
+            std::ignore = lexer.next();
+        }
+
+        auto const name = lexer.next();
+        if (not is_identifier(name)) {
+            throw csp_error(std::format("{}:{}: Expecting a loop-variable name, found '{}'.", _path, line_nr, name));
+        }
+        expect(lexer, ":", line_nr);
+        auto const list = variable(lexer.next(), line_nr);
+        expect(lexer, ")", line_nr);
+        expect(lexer, "{", line_nr);
+
+        auto& slots = _program._slots;
+        slots.push_back({std::string{name}, detail::csp_slot_type::loop_variable, _path, line_nr});
+        auto const loop_variable = static_cast<uint32_t>(slots.size() - 1);
+
+        _program._loops.push_back({list, loop_variable, _path, line_nr});
+        auto const loop = static_cast<uint32_t>(_program._loops.size() - 1);
+
+        auto b = block{block_type::loop, line_nr, _program._code.size()};
+        b.loop = loop;
+        b.num_scope = _scope.size();
+        emit(detail::csp_opcode::loop_start, loop);
+        b.body = pc();
+
+        _blocks.push_back(std::move(b));
+        _scope.emplace_back(std::string{name}, loop_variable);
+    }
+
+    void add_close(detail::csp_interpreter_lexer& lexer, int line_nr)
+    {
+        if (_blocks.empty()) {
+            throw csp_error(std::format("{}:{}: Unexpected '}}'.", _path, line_nr));
+        }
+
+        auto& b = _blocks.back();
+        _scope.resize(b.num_scope);
+
+        if (lexer.peek() == "else") {
+            std::ignore = lexer.next();
+            if (b.type != block_type::condition) {
+                throw csp_error(std::format("{}:{}: Unexpected 'else' after a for-loop.", _path, line_nr));
+            }
+            if (not b.patch) {
+                throw csp_error(std::format("{}:{}: Unexpected 'else' after 'else'.", _path, line_nr));
+            }
+
+            b.end_patches.push_back(_program._code.size());
+            emit(detail::csp_opcode::jump);
+            patch(*b.patch);
+
+            if (lexer.peek() == "if") {
+                std::ignore = lexer.next();
+                b.patch = add_condition(lexer, line_nr);
+            } else {
+                expect(lexer, "{", line_nr);
+                b.patch = std::nullopt;
+            }
+            return;
+        }
+
+        if (b.type == block_type::loop) {
+            emit(detail::csp_opcode::loop_next, b.loop, b.body);
+            patch(*b.patch);
+        } else {
+            if (b.patch) {
+                patch(*b.patch);
+            }
+            for (auto i : b.end_patches) {
+                patch(i);
+            }
+        }
+        _blocks.pop_back();
+    }
+
+    void add_verbatim(std::string_view text, int line_nr)
+    {
+        auto lexer = detail::csp_interpreter_lexer{text};
+        while (true) {
+            auto const token = lexer.next();
+            if (token.empty()) {
+                return;
+
+            } else if (token == "for") {
+                add_for(lexer, line_nr);
+
+            } else if (token == "if") {
+                auto b = block{block_type::condition, line_nr, add_condition(lexer, line_nr)};
+                b.num_scope = _scope.size();
+                _blocks.push_back(std::move(b));
+
+            } else if (token == "}") {
+                add_close(lexer, line_nr);
+
+            } else {
+                throw csp_error(std::format("{}:{}: Unsupported C++ '{}' in interpreted template.", _path, line_nr, token));
+            }
+        }
+    }
+};
+
+template<std::input_iterator It, std::sentinel_for<It> ItEnd>
+csp_program::csp_program(It first, ItEnd last, std::filesystem::path path, csp_filters const& filters) :
+    _path(std::move(path))
+{
+    auto compiler = program_compiler{*this, filters};
+    for (auto it = first; it != last; ++it) {
+        compiler.add(*it);
+    }
+    compiler.finish();
+}
+
+/** Compile a template for the interpreter.
+ *
+ * The template is parsed in text-mode, like an included template.
+ *
+ * @param text The text of the template.
+ * @param path The path of the template, used for error messages and includes.
+ * @param filters The filters that the template may use.
+ * @throws csp_error When the template uses more than the supported subset.
+ */
+[[nodiscard]] inline csp_program
+compile_csp(std::string_view text, std::filesystem::path const& path, csp_filters const& filters = {})
+{
+    auto config = parse_csp_config{};
+    config.start_in_text = true;
+
+    auto tokens = parse_csp(text, path, config);
+    return csp_program(tokens.begin(), tokens.end(), path, filters);
+}
+
+}} // namespace csp::v1
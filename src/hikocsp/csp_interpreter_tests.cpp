@@ -0,0 +1,118 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "csp_interpreter.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace csp_interpreter_tests {
+
+[[nodiscard]] std::string upper(std::string str)
+{
+    for (auto& c : str) {
+        if (c >= 'a' and c <= 'z') {
+            c = c - 'a' + 'A';
+        }
+    }
+    return str;
+}
+
+[[nodiscard]] std::string bracket(std::string str)
+{
+    return "[" + str + "]";
+}
+
+[[nodiscard]] std::string render(std::string_view text, csp::csp_variables const& variables)
+{
+    auto const filters = csp::csp_filters{{"upper", upper}, {"bracket", bracket}};
+    return csp::compile_csp(text, "<none>", filters).render(variables);
+}
+
+} // namespace csp_interpreter_tests
+
+TEST(csp_interpreter, text)
+{
+    ASSERT_EQ(csp_interpreter_tests::render("foo\nbar", {}), "foo\nbar");
+    ASSERT_EQ(csp_interpreter_tests::render("", {}), "");
+}
+
+TEST(csp_interpreter, placeholder)
+{
+    auto const variables = csp::csp_variables{{"a", 42}, {"b", "foo"}, {"c", 1.5}, {"d", true}};
+
+    ASSERT_EQ(csp_interpreter_tests::render("x${a}y", variables), "x42y");
+    ASSERT_EQ(csp_interpreter_tests::render("${b}${c}${d}", variables), "foo1.5true");
+    ASSERT_EQ(csp_interpreter_tests::render("${\"{:>4}|{:<4}\", a, b}", variables), "  42|foo ");
+    ASSERT_EQ(csp_interpreter_tests::render("${\"{:+} {}\", 5, \"bar\"}", variables), "+5 bar");
+    ASSERT_EQ(csp_interpreter_tests::render("${\"}}\\n\"}${}", variables), "}}\n");
+}
+
+TEST(csp_interpreter, filters)
+{
+    auto const variables = csp::csp_variables{{"a", "foo"}};
+
+    ASSERT_EQ(csp_interpreter_tests::render("${a`upper}", variables), "FOO");
+    ASSERT_EQ(csp_interpreter_tests::render("${a`upper`bracket}", variables), "[FOO]");
+    ASSERT_EQ(csp_interpreter_tests::render("${`bracket}${a}${a`}${\"x\"}${a}", variables), "[foo]foox[foo]");
+}
+
+TEST(csp_interpreter, for_loop)
+{
+    auto const variables = csp::csp_variables{{"list", std::vector{1, 2, 3}}, {"empty", std::vector<int>{}}, {"x", 0}};
+
+    ASSERT_EQ(
+        csp_interpreter_tests::render("<ul>\n$for (auto const &x : list) {\n<li>${x}</li>\n$}\n</ul>\n", variables),
+        "<ul>\n<li>1</li>\n<li>2</li>\n<li>3</li>\n</ul>\n");
+    ASSERT_EQ(csp_interpreter_tests::render("$for (auto x : empty) {\n${x}\n$}\n${x}", variables), "0");
+    ASSERT_EQ(
+        csp_interpreter_tests::render("$for (auto x : list) {\n$for (auto y : list) {\n${x}${y} $}\n$}\n", variables),
+        "11 12 13 21 22 23 31 32 33 ");
+}
+
+TEST(csp_interpreter, if_else)
+{
+    auto const variables = csp::csp_variables{{"yes", true}, {"no", false}, {"zero", 0}, {"list", std::vector{0, 1, 2}}};
+
+    ASSERT_EQ(csp_interpreter_tests::render("$if (yes) {\na$} else {\nb$}\n", variables), "a");
+    ASSERT_EQ(csp_interpreter_tests::render("$if (no) {\na$} else {\nb$}\n", variables), "b");
+    ASSERT_EQ(csp_interpreter_tests::render("$if (not zero) {\na$}\n", variables), "a");
+    ASSERT_EQ(csp_interpreter_tests::render("$if (!yes) {\na$}\n", variables), "");
+    ASSERT_EQ(
+        csp_interpreter_tests::render(
+            "$for (auto x : list) {\n$if (no) {\na$} else if (x) {\n${x}$} else {\nz$}\n$}\n", variables),
+        "z12");
+}
+
+TEST(csp_interpreter, errors)
+{
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("${a + 1}", {{"a", 1}}), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("$while (a) {\n$}\n", {{"a", 1}}), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("$if (a) {\n", {{"a", 1}}), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("$}\n", {}), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("${a`unknown}", {{"a", 1}}), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("${a}", {}), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("$for (auto x : a) {\n$}\n", {{"a", 1}}), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_interpreter_tests::render("$if (a) {\n$}\n", {{"a", "foo"}}), csp::csp_error);
+}
+
+TEST(csp_interpreter, error_path)
+{
+    // An unknown variable used in an included template.
+    auto const path = std::string_view{"include.csp"};
+    auto const name = std::string_view{"a"};
+
+    auto tokens = std::vector<csp::csp_token<std::string_view::iterator>>{};
+    tokens.emplace_back(csp::csp_token_type::path, 1, path.begin(), path.end());
+    tokens.emplace_back(csp::csp_token_type::placeholder_argument, 3, name.begin(), name.end());
+    tokens.emplace_back(csp::csp_token_type::placeholder_end, 3);
+
+    auto const program = csp::csp_program(tokens.begin(), tokens.end(), "page.csp", csp::csp_filters{});
+    try {
+        std::ignore = program.render({});
+        FAIL();
+    } catch (csp::csp_error const& e) {
+        ASSERT_EQ(std::string{e.what()}, "include.csp:3: Unknown variable a.");
+    }
+}
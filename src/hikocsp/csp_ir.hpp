@@ -0,0 +1,479 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "csp_token.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <set>
+#include <algorithm>
+#include <iterator>
+#include <exception>
+#include <cctype>
+
+namespace csp { inline namespace v1 {
+
+/** The type of an IR node.
+ */
+enum class csp_ir_kind {
+    /** C++ code copied into the generated code. */
+    verbatim,
+
+    /** Template-text, `text` is the text to output. */
+    text,
+
+    /** A C++ expression output without formatting, `text` is the expression. */
+    escape,
+
+    /** A formatted placeholder with `arguments` passed to std::format() and `filters` applied to the result.
+     *
+     * When `filters` is empty the default filters are used.
+     */
+    placeholder,
+
+    /** Change the default filters to `filters`. */
+    default_filters,
+
+    /** The nodes that follow come from the file `text`, starting at `line_nr`. */
+    path,
+
+    /** Start of a region whose output is cached, `text` is the key expression. */
+    cache,
+
+    /** End of a region started by a directive. */
+    end,
+
+    /** Send the output so far to the caller. */
+    flush,
+
+    /** Start of a region of sections rendered concurrently, `text` is the executor expression.
+     *
+     * The first section starts directly after this node.
+     */
+    parallel,
+
+    /** Start of the next section in a parallel region. */
+    section
+};
+
+/** A node of the intermediate representation between the parser and translator.
+ *
+ * An empty string in `filters` is the identity filter.
+ */
+struct csp_ir_node {
+    csp_ir_kind kind;
+    int line_nr = 0;
+    std::string text = {};
+    std::vector<std::string> arguments = {};
+    std::vector<std::string> filters = {};
+
+    [[nodiscard]] friend bool operator==(csp_ir_node const&, csp_ir_node const&) = default;
+};
+
+using csp_ir = std::vector<csp_ir_node>;
+
+/** Lower the tokens from the parser into IR.
+ *
+ * @param first An iterator to the first token.
+ * @param last A sentinel beyond the last token.
+ * @return The IR nodes.
+ */
+template<std::input_iterator It, std::sentinel_for<It> ItEnd>
+[[nodiscard]] csp_ir lower_csp(It first, ItEnd last)
+{
+    auto r = csp_ir{};
+    auto arguments = std::vector<std::string>{};
+    auto filters = std::vector<std::string>{};
+
+    for (auto it = first; it != last; ++it) {
+        auto const& token = *it;
+        if (token.kind == csp_token_type::verbatim) {
+            if (not token.text.empty()) {
+                r.emplace_back(csp_ir_kind::verbatim, token.line_nr, std::string{token.text});
+            }
+
+        } else if (token.kind == csp_token_type::text) {
+            if (not token.text.empty()) {
+                r.emplace_back(csp_ir_kind::text, token.line_nr, std::string{token.text});
+            }
+
+        } else if (token.kind == csp_token_type::path) {
+            r.emplace_back(csp_ir_kind::path, token.line_nr, std::string{token.text});
+
+        } else if (token.kind == csp_token_type::cache) {
+            r.emplace_back(csp_ir_kind::cache, token.line_nr, std::string{token.text});
+
+        } else if (token.kind == csp_token_type::end) {
+            r.emplace_back(csp_ir_kind::end, token.line_nr);
+
+        } else if (token.kind == csp_token_type::flush) {
+            r.emplace_back(csp_ir_kind::flush, token.line_nr);
+
+        } else if (token.kind == csp_token_type::parallel) {
+            r.emplace_back(csp_ir_kind::parallel, token.line_nr, std::string{token.text});
+
+        } else if (token.kind == csp_token_type::section) {
+            r.emplace_back(csp_ir_kind::section, token.line_nr);
+
+        } else if (token.kind == csp_token_type::placeholder_argument) {
+            arguments.emplace_back(token.text);
+
+        } else if (token.kind == csp_token_type::placeholder_filter) {
+            filters.emplace_back(token.text);
+
+        } else if (token.kind == csp_token_type::placeholder_end) {
+            if (arguments.empty()) {
+                if (not filters.empty()) {
+                    r.emplace_back(
+                        csp_ir_kind::default_filters, token.line_nr, std::string{}, std::vector<std::string>{}, std::move(filters));
+                }
+
+            } else if (
+                filters.empty() and arguments.size() == 1 and arguments.front().front() == '"' and
+                arguments.front().back() == '"') {
+                r.emplace_back(csp_ir_kind::escape, token.line_nr, std::move(arguments.front()));
+
+            } else {
+                if (arguments.size() == 1) {
+                    arguments.emplace(arguments.begin(), "\"{}\"");
+                }
+                r.emplace_back(
+                    csp_ir_kind::placeholder, token.line_nr, std::string{}, std::move(arguments), std::move(filters));
+            }
+
+            arguments.clear();
+            filters.clear();
+
+        } else {
+            std::terminate();
+        }
+    }
+
+    return r;
+}
+
+/** Merge adjacent text nodes.
+ *
+ * Fewer, larger, pieces of text reduce the number of calls to the sink.
+ */
+inline void coalesce_text_pass(csp_ir& ir)
+{
+    auto out = ir.begin();
+    for (auto it = ir.begin(); it != ir.end(); ++it) {
+        if (out != ir.begin() and it->kind == csp_ir_kind::text and std::prev(out)->kind == csp_ir_kind::text) {
+            std::prev(out)->text += it->text;
+        } else {
+            if (out != it) {
+                *out = std::move(*it);
+            }
+            ++out;
+        }
+    }
+    ir.erase(out, ir.end());
+}
+
+/** Replace escapes of plain string-literals with text.
+ *
+ * `${"<br>"}` becomes the text `<br>`, which may then be merged with the
+ * surrounding text. String-literals with escape sequences, prefixes or
+ * concatenation are left alone.
+ */
+inline void fold_escapes_pass(csp_ir& ir)
+{
+    for (auto& node : ir) {
+        if (node.kind != csp_ir_kind::escape or node.text.size() < 2 or not node.text.starts_with('"') or
+            not node.text.ends_with('"')) {
+            continue;
+        }
+
+        auto const inner = std::string_view{node.text}.substr(1, node.text.size() - 2);
+        if (inner.find_first_of("\"\\\n") == inner.npos) {
+            node.kind = csp_ir_kind::text;
+            node.text = std::string{inner};
+        }
+    }
+}
+
+/** Resolve the default filters of each placeholder.
+ *
+ * Afterwards placeholders carry their own filters and the default-filter nodes
+ * are removed.
+ */
+inline void resolve_default_filters_pass(csp_ir& ir)
+{
+    auto default_filters = std::vector<std::string>{};
+
+    auto out = ir.begin();
+    for (auto it = ir.begin(); it != ir.end(); ++it) {
+        if (it->kind == csp_ir_kind::default_filters) {
+            default_filters = std::move(it->filters);
+            continue;
+        }
+
+        if (it->kind == csp_ir_kind::placeholder and it->filters.empty()) {
+            it->filters = default_filters;
+        }
+        if (out != it) {
+            *out = std::move(*it);
+        }
+        ++out;
+    }
+    ir.erase(out, ir.end());
+}
+
+/** Remove default-filter changes which are not used by a placeholder.
+ */
+inline void eliminate_dead_default_filters_pass(csp_ir& ir)
+{
+    // Walk backward to know if a placeholder uses the default filters before they are changed again.
+    auto is_dead = std::vector<bool>(ir.size(), false);
+    auto is_used = false;
+    for (auto i = ir.size(); i != 0; --i) {
+        auto const& node = ir[i - 1];
+        if (node.kind == csp_ir_kind::placeholder and node.filters.empty()) {
+            is_used = true;
+
+        } else if (node.kind == csp_ir_kind::default_filters) {
+            is_dead[i - 1] = not is_used;
+            is_used = false;
+        }
+    }
+
+    auto out = std::size_t{0};
+    for (auto i = std::size_t{0}; i != ir.size(); ++i) {
+        if (is_dead[i]) {
+            continue;
+        }
+        if (out != i) {
+            ir[out] = std::move(ir[i]);
+        }
+        ++out;
+    }
+    ir.erase(ir.begin() + out, ir.end());
+}
+
+/** Remove identity filters.
+ *
+ * An identity filter is only needed to override the default filters with no
+ * filtering at all; it is removed when other filters are applied as well, or
+ * when there are no default filters.
+ */
+inline void eliminate_identity_filters_pass(csp_ir& ir)
+{
+    auto const has_default_filters = std::ranges::any_of(ir, [](auto const& node) {
+        return node.kind == csp_ir_kind::default_filters;
+    });
+
+    for (auto& node : ir) {
+        if (node.kind != csp_ir_kind::placeholder and node.kind != csp_ir_kind::default_filters) {
+            continue;
+        }
+
+        auto const has_other_filters = std::ranges::any_of(node.filters, [](auto const& filter) {
+            return not filter.empty();
+        });
+
+        if (has_other_filters or (node.kind == csp_ir_kind::placeholder and not has_default_filters)) {
+            std::erase(node.filters, std::string{});
+        }
+    }
+}
+
+namespace detail {
+
+[[nodiscard]] constexpr bool is_html_whitespace(char c) noexcept
+{
+    return c == ' ' or c == '\t' or c == '\n' or c == '\r' or c == '\f';
+}
+
+[[nodiscard]] constexpr char to_lower_ascii(char c) noexcept
+{
+    return c >= 'A' and c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/** Check if an element name appears at the start of the text.
+ *
+ * @param str The text following '<' or '</'.
+ * @param name The lower-case name of the element.
+ */
+[[nodiscard]] constexpr bool starts_with_html_name(std::string_view str, std::string_view name) noexcept
+{
+    if (str.size() < name.size()) {
+        return false;
+    }
+    for (auto i = std::size_t{0}; i != name.size(); ++i) {
+        if (to_lower_ascii(str[i]) != name[i]) {
+            return false;
+        }
+    }
+    // The end of the text may be followed by a placeholder with attributes.
+    return str.size() == name.size() or is_html_whitespace(str[name.size()]) or str[name.size()] == '>' or
+        str[name.size()] == '/';
+}
+
+/** The state of the HTML minifier, kept between pieces of text.
+ */
+struct html_minifier {
+    /** The elements in which whitespace is kept.
+     */
+    constexpr static auto raw_elements = std::array<std::string_view, 4>{"pre", "textarea", "script", "style"};
+
+    /** The raw element the minifier is in, or empty.
+     */
+    std::string_view raw_element = {};
+
+    /** The minifier is inside a comment.
+     */
+    bool in_comment = false;
+
+    /** The minifier is inside a tag.
+     */
+    bool in_tag = false;
+
+    /** The quote character of the attribute value the minifier is in, or nul.
+     */
+    char quote = '\0';
+
+    [[nodiscard]] std::string minify(std::string_view text)
+    {
+        auto r = std::string{};
+        r.reserve(text.size());
+
+        auto i = std::size_t{0};
+        while (i != text.size()) {
+            auto const c = text[i];
+            auto const rest = text.substr(i);
+
+            if (in_comment) {
+                if (rest.starts_with("-->")) {
+                    in_comment = false;
+                    r += "-->";
+                    i += 3;
+                    continue;
+                }
+
+            } else if (not raw_element.empty()) {
+                if (rest.starts_with("</") and starts_with_html_name(rest.substr(2), raw_element)) {
+                    raw_element = {};
+                    in_tag = true;
+                }
+
+            } else if (quote != '\0') {
+                if (c == quote) {
+                    quote = '\0';
+                }
+
+            } else if (is_html_whitespace(c)) {
+                auto has_newline = false;
+                for (; i != text.size() and is_html_whitespace(text[i]); ++i) {
+                    has_newline |= text[i] == '\n';
+                }
+                r += has_newline ? '\n' : ' ';
+                continue;
+
+            } else if (in_tag) {
+                if (c == '"' or c == '\'') {
+                    quote = c;
+                } else if (c == '>') {
+                    in_tag = false;
+                }
+
+            } else if (rest.starts_with("<!--")) {
+                in_comment = true;
+                r += "<!--";
+                i += 4;
+                continue;
+
+            } else if (c == '<' and rest.size() > 1 and (rest[1] == '/' or rest[1] == '!' or std::isalpha(static_cast<unsigned char>(rest[1])))) {
+                in_tag = true;
+                for (auto raw_name : raw_elements) {
+                    if (starts_with_html_name(rest.substr(1), raw_name)) {
+                        raw_element = raw_name;
+                    }
+                }
+            }
+
+            r += c;
+            ++i;
+        }
+
+        return r;
+    }
+};
+
+} // namespace detail
+
+/** Collapse runs of whitespace in HTML template-text.
+ *
+ * Each run of whitespace is replaced by a single line-feed if the run contained
+ * one, otherwise by a single space. Whitespace inside attribute values,
+ * comments and the `pre`, `textarea`, `script` and `style` elements is kept.
+ *
+ * Whitespace is not removed completely, as between inline elements it is
+ * rendered.
+ */
+inline void minify_html_pass(csp_ir& ir)
+{
+    auto minifier = detail::html_minifier{};
+    for (auto& node : ir) {
+        if (node.kind == csp_ir_kind::text) {
+            node.text = minifier.minify(node.text);
+        }
+    }
+}
+
+struct csp_pass {
+    /** The name of the pass, used on the command line.
+     */
+    std::string_view name;
+
+    void (*function)(csp_ir&);
+
+    /** The pass is run, unless it is disabled explicitly.
+     */
+    bool enabled_by_default = true;
+};
+
+/** The optimization passes, in the order they are run.
+ */
+constexpr auto csp_passes = std::array{
+    csp_pass{"eliminate-dead-default-filters", eliminate_dead_default_filters_pass},
+    csp_pass{"resolve-default-filters", resolve_default_filters_pass},
+    csp_pass{"eliminate-identity-filters", eliminate_identity_filters_pass},
+    csp_pass{"fold-escapes", fold_escapes_pass},
+    csp_pass{"coalesce-text", coalesce_text_pass},
+    csp_pass{"minify-html", minify_html_pass, false}};
+
+/** Check if a pass with the given name exists.
+ */
+[[nodiscard]] constexpr bool is_csp_pass(std::string_view name) noexcept
+{
+    return std::ranges::any_of(csp_passes, [name](auto const& pass) {
+        return pass.name == name;
+    });
+}
+
+/** Run the optimization passes.
+ *
+ * @param ir The IR to optimize.
+ * @param disabled_passes The names of the passes to skip.
+ * @param enabled_passes The names of the passes to run that are not enabled by default.
+ */
+inline void run_csp_passes(
+    csp_ir& ir,
+    std::set<std::string, std::less<>> const& disabled_passes,
+    std::set<std::string, std::less<>> const& enabled_passes = {})
+{
+    for (auto const& pass : csp_passes) {
+        auto const enabled = pass.enabled_by_default ? not disabled_passes.contains(pass.name) : enabled_passes.contains(pass.name);
+        if (enabled) {
+            pass.function(ir);
+        }
+    }
+}
+
+}} // namespace csp::v1
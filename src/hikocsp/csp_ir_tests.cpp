@@ -0,0 +1,195 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "csp_ir.hpp"
+#include "csp_parser.hpp"
+#include "csp_translator.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+namespace csp_ir_tests {
+
+using csp::csp_ir_kind;
+using csp::csp_ir_node;
+
+[[nodiscard]] csp::csp_ir lower(std::string_view str)
+{
+    auto tokens = csp::parse_csp(str, "<none>");
+    return csp::lower_csp(tokens.begin(), tokens.end());
+}
+
+[[nodiscard]] std::string translate(std::string_view str, std::set<std::string, std::less<>> disabled_passes = {})
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.disabled_passes = std::move(disabled_passes);
+
+    auto tokens = csp::parse_csp(str, "<none>");
+    auto r = std::string{};
+    for (auto const& s : csp::translate_csp(tokens.begin(), tokens.end(), "<none>", config)) {
+        r += s;
+    }
+    return r;
+}
+
+} // namespace csp_ir_tests
+
+using csp_ir_tests::csp_ir_kind;
+using csp_ir_tests::csp_ir_node;
+
+TEST(csp_ir, lower)
+{
+    auto const ir = csp_ir_tests::lower("{{<td>${`html}${a}${\"&amp;\"}${\"{:x}\", b`}}}");
+
+    ASSERT_EQ(ir.size(), 5);
+    ASSERT_EQ(ir[0], (csp_ir_node{csp_ir_kind::text, 1, "<td>"}));
+    ASSERT_EQ(ir[1], (csp_ir_node{csp_ir_kind::default_filters, 1, "", {}, {"html"}}));
+    ASSERT_EQ(ir[2], (csp_ir_node{csp_ir_kind::placeholder, 1, "", {"\"{}\"", "a"}, {}}));
+    ASSERT_EQ(ir[3], (csp_ir_node{csp_ir_kind::escape, 1, "\"&amp;\""}));
+    ASSERT_EQ(ir[4], (csp_ir_node{csp_ir_kind::placeholder, 1, "", {"\"{:x}\"", " b"}, {""}}));
+}
+
+TEST(csp_ir, coalesce_text)
+{
+    auto ir = csp::csp_ir{
+        {csp_ir_kind::text, 1, "a"},
+        {csp_ir_kind::text, 1, "b"},
+        {csp_ir_kind::verbatim, 2, "x();"},
+        {csp_ir_kind::text, 3, "c"},
+        {csp_ir_kind::text, 4, "d"},
+        {csp_ir_kind::text, 4, "e"}};
+
+    csp::coalesce_text_pass(ir);
+    ASSERT_EQ(ir.size(), 3);
+    ASSERT_EQ(ir[0], (csp_ir_node{csp_ir_kind::text, 1, "ab"}));
+    ASSERT_EQ(ir[1], (csp_ir_node{csp_ir_kind::verbatim, 2, "x();"}));
+    ASSERT_EQ(ir[2], (csp_ir_node{csp_ir_kind::text, 3, "cde"}));
+}
+
+TEST(csp_ir, fold_escapes)
+{
+    auto ir = csp::csp_ir{
+        {csp_ir_kind::escape, 1, "\"&amp;\""},
+        {csp_ir_kind::escape, 1, "\"\\n\""},
+        {csp_ir_kind::escape, 1, "\"a\" \"b\""},
+        {csp_ir_kind::escape, 1, "u8\"a\""}};
+
+    csp::fold_escapes_pass(ir);
+    ASSERT_EQ(ir[0], (csp_ir_node{csp_ir_kind::text, 1, "&amp;"}));
+    ASSERT_EQ(ir[1].kind, csp_ir_kind::escape);
+    ASSERT_EQ(ir[2].kind, csp_ir_kind::escape);
+    ASSERT_EQ(ir[3].kind, csp_ir_kind::escape);
+}
+
+TEST(csp_ir, resolve_default_filters)
+{
+    auto ir = csp::csp_ir{
+        {csp_ir_kind::placeholder, 1, "", {"\"{}\"", "a"}, {}},
+        {csp_ir_kind::default_filters, 2, "", {}, {"html"}},
+        {csp_ir_kind::placeholder, 3, "", {"\"{}\"", "b"}, {}},
+        {csp_ir_kind::placeholder, 4, "", {"\"{}\"", "c"}, {"url"}}};
+
+    csp::resolve_default_filters_pass(ir);
+    ASSERT_EQ(ir.size(), 3);
+    ASSERT_TRUE(ir[0].filters.empty());
+    ASSERT_EQ(ir[1].filters, std::vector<std::string>{"html"});
+    ASSERT_EQ(ir[2].filters, std::vector<std::string>{"url"});
+}
+
+TEST(csp_ir, eliminate_dead_default_filters)
+{
+    auto ir = csp::csp_ir{
+        {csp_ir_kind::default_filters, 1, "", {}, {"a"}},
+        {csp_ir_kind::default_filters, 2, "", {}, {"b"}},
+        {csp_ir_kind::placeholder, 3, "", {"\"{}\"", "x"}, {"c"}},
+        {csp_ir_kind::placeholder, 4, "", {"\"{}\"", "x"}, {}},
+        {csp_ir_kind::default_filters, 5, "", {}, {"d"}}};
+
+    csp::eliminate_dead_default_filters_pass(ir);
+    ASSERT_EQ(ir.size(), 3);
+    ASSERT_EQ(ir[0], (csp_ir_node{csp_ir_kind::default_filters, 2, "", {}, {"b"}}));
+    ASSERT_EQ(ir[1].line_nr, 3);
+    ASSERT_EQ(ir[2].line_nr, 4);
+}
+
+TEST(csp_ir, eliminate_identity_filters)
+{
+    auto ir = csp::csp_ir{
+        {csp_ir_kind::placeholder, 1, "", {"\"{}\"", "x"}, {"", "html", ""}},
+        {csp_ir_kind::placeholder, 2, "", {"\"{}\"", "x"}, {""}}};
+
+    csp::eliminate_identity_filters_pass(ir);
+    ASSERT_EQ(ir[0].filters, std::vector<std::string>{"html"});
+    // Without default filters an identity filter does nothing.
+    ASSERT_TRUE(ir[1].filters.empty());
+
+    ir.insert(ir.begin(), csp_ir_node{csp_ir_kind::default_filters, 0, "", {}, {"html"}});
+    ir[2].filters = {""};
+    csp::eliminate_identity_filters_pass(ir);
+    // The identity filter overrides the default filters.
+    ASSERT_EQ(ir[2].filters, std::vector<std::string>{""});
+}
+
+TEST(csp_ir, is_csp_pass)
+{
+    for (auto const& pass : csp::csp_passes) {
+        ASSERT_TRUE(csp::is_csp_pass(pass.name));
+    }
+    ASSERT_FALSE(csp::is_csp_pass("foo"));
+}
+
+TEST(csp_ir, translate)
+{
+    auto const str = "{{<b>${\"&amp;\"}</b>${`html}${a`}}}";
+
+    ASSERT_EQ(csp_ir_tests::translate(str), "co_yield \"<b>&amp;</b>\";\nco_yield std::format((\"{}\"), (a));\n");
+
+    auto disabled_passes = std::set<std::string, std::less<>>{};
+    for (auto const& pass : csp::csp_passes) {
+        disabled_passes.emplace(pass.name);
+    }
+    ASSERT_EQ(
+        csp_ir_tests::translate(str, disabled_passes),
+        "co_yield \"<b>\";\n"
+        "co_yield \"&amp;\";\n"
+        "co_yield \"</b>\";\n"
+        "co_yield ([](auto const &x){return x;})(std::format((\"{}\"), (a)));\n");
+}
+
+TEST(csp_ir, minify_html)
+{
+    auto ir = csp::csp_ir{
+        {csp_ir_kind::text, 1, "<ul>\n    <li   class=\"a   b\">  x  </li>\n"},
+        {csp_ir_kind::placeholder, 2, "", {"\"{}\"", "x"}, {}},
+        {csp_ir_kind::text, 2, "  <PRE>\n  keep   this\n</pre>   <!--  don't  -->\n\n</ul>"},
+        {csp_ir_kind::text, 5, "<a  title='"},
+        {csp_ir_kind::placeholder, 5, "", {"\"{}\"", "title"}, {}},
+        {csp_ir_kind::text, 5, "   '>  <script>\n  if (a  <  b) {}\n</script>"}};
+
+    csp::minify_html_pass(ir);
+    ASSERT_EQ(ir[0].text, "<ul>\n<li class=\"a   b\"> x </li>\n");
+    ASSERT_EQ(ir[2].text, " <PRE>\n  keep   this\n</pre> <!--  don't  -->\n</ul>");
+    ASSERT_EQ(ir[3].text, "<a title='");
+    ASSERT_EQ(ir[5].text, "   '> <script>\n  if (a  <  b) {}\n</script>");
+}
+
+TEST(csp_ir, enabled_passes)
+{
+    auto const str = "{{<p>\n  ${a}\n</p>}}";
+
+    ASSERT_EQ(
+        csp_ir_tests::translate(str),
+        "co_yield \"<p>\\n\"\n  \"  \";\nco_yield std::format((\"{}\"), (a));\nco_yield \"\\n\"\n  \"</p>\";\n");
+
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.enabled_passes = {"minify-html"};
+
+    auto tokens = csp::parse_csp(str, "<none>");
+    auto r = std::string{};
+    for (auto const& s : csp::translate_csp(tokens.begin(), tokens.end(), "<none>", config)) {
+        r += s;
+    }
+    ASSERT_EQ(r, "co_yield \"<p>\\n\";\nco_yield std::format((\"{}\"), (a));\nco_yield \"\\n\"\n  \"</p>\";\n");
+}
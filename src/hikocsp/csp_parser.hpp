@@ -8,8 +8,11 @@
 #include "csp_error.hpp"
 #include "csp_token.hpp"
 #include <string_view>
+#include <string>
+#include <vector>
 #include <format>
 #include <filesystem>
+#include <fstream>
 #include <cstddef>
 #include <cstdint>
 #include <array>
@@ -17,6 +20,31 @@
 #include <concepts>
 
 namespace csp { inline namespace v1 {
+
+struct parse_csp_config {
+    /** Start parsing in text-mode instead of verbatim C++ mode.
+     *
+     * This is how included templates are parsed.
+     */
+    bool start_in_text = false;
+
+    /** When set, the path of each included template is appended to this list.
+     */
+    std::vector<std::filesystem::path> *dependencies = nullptr;
+
+    /** The number of includes that are being parsed.
+     */
+    int include_depth = 0;
+
+    /** When set, errors are appended to this list instead of thrown.
+     *
+     * After an error the rest of the placeholder or directive is skipped and
+     * parsing continues, so that all errors of a template are found in a
+     * single pass. The tokens of a template with errors should not be translated.
+     */
+    std::vector<csp_diagnostic> *diagnostics = nullptr;
+};
+
 namespace detail {
 
 enum class parse_csp_after_text : uint8_t { placeholder, line_verbatim, verbatim, text };
@@ -131,6 +159,8 @@ template<std::random_access_iterator It>
  * It also counts the number of new-lines found inside the expression.
  *
  * @param str The string to parse.
+ * @param error Set to the message of an error, in which case `first` points
+ *              at the error and `line_nr` is the line of the error.
  * @return iterator or last on error, number of lines in the expression.
  *
  * Due to bug in MSVC: https://developercommunity.visualstudio.com/t/C3615-false-positive-when-early-return-f/10395567
@@ -138,7 +168,7 @@ template<std::random_access_iterator It>
  */
 template<std::random_access_iterator It>
 [[nodiscard]] csp_token<It>
-parse_csp_expression(It& first, It last, std::filesystem::path const& path, int& line_nr, bool is_filter)
+parse_csp_expression(It& first, It last, int& line_nr, bool is_filter, std::string& error)
 {
     auto quote = '\0';
     bool escape = false;
@@ -173,7 +203,10 @@ parse_csp_expression(It& first, It last, std::filesystem::path const& path, int&
         case '[':
             if (not quote) {
                 if (stack_size == stack.size()) {
-                    throw csp_error(std::format("{}:{}: Subexpression nesting is too deep.", path.string(), line_nr));
+                    error = "Subexpression nesting is too deep.";
+                    line_nr += num_lines;
+                    first = it;
+                    return r;
                 }
                 stack[stack_size++] = *it == '{' ? '}' : *it == '(' ? ')' : ']';
             }
@@ -190,12 +223,10 @@ parse_csp_expression(It& first, It last, std::filesystem::path const& path, int&
                     return r;
 
                 } else if (stack[--stack_size] != *it) {
-                    throw csp_error(std::format(
-                        "{}:{}: Unexpected {} when terminating subexpression, expecting {}",
-                        path.string(),
-                        line_nr,
-                        *it,
-                        stack[stack_size]));
+                    error = std::format("Unexpected {} when terminating subexpression, expecting {}.", *it, stack[stack_size]);
+                    line_nr += num_lines;
+                    first = it;
+                    return r;
                 }
             }
             break;
@@ -222,7 +253,10 @@ parse_csp_expression(It& first, It last, std::filesystem::path const& path, int&
         escape = false;
     }
 
-    throw csp_error(std::format("{}:{}: Unexpected EOF parsing C++ expression", path.string(), line_nr));
+    error = "Unexpected EOF parsing C++ expression.";
+    line_nr += num_lines;
+    first = last;
+    return r;
 }
 
 template<std::random_access_iterator It>
@@ -320,22 +354,167 @@ template<std::random_access_iterator It>
     return r;
 }
 
+/** Parse the name of a directive.
+ *
+ * @param first Iterator pointing after the '@', on return pointing after the name.
+ * @param last Iterator pointing after the end of the template.
+ * @return The name of the directive.
+ */
+template<std::random_access_iterator It>
+[[nodiscard]] constexpr std::string parse_csp_directive_name(It& first, It last) noexcept
+{
+    auto it = first;
+    for (; it != last; ++it) {
+        auto const c = *it;
+        if (not((c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or c == '_')) {
+            break;
+        }
+    }
+
+    auto r = std::string{first, it};
+    first = it;
+    return r;
+}
+
+/** Parse the path of an include directive.
+ *
+ * @param str The argument of the directive, a string-literal.
+ * @param error Set to the message of an error.
+ * @return The path of the template to include.
+ */
+[[nodiscard]] inline std::filesystem::path parse_csp_include_path(std::string_view str, std::string& error)
+{
+    while (not str.empty() and (str.front() == ' ' or str.front() == '\t' or str.front() == '\n')) {
+        str.remove_prefix(1);
+    }
+    while (not str.empty() and (str.back() == ' ' or str.back() == '\t' or str.back() == '\n')) {
+        str.remove_suffix(1);
+    }
+
+    if (str.size() < 2 or str.front() != '"' or str.back() != '"') {
+        error = "Expecting a string-literal as argument of @include.";
+        return {};
+    }
+
+    auto r = std::string{};
+    for (auto it = str.begin() + 1; it != str.end() - 1; ++it) {
+        if (*it == '\\' and it + 1 != str.end() - 1) {
+            ++it;
+        }
+        r += *it;
+    }
+    return r;
+}
+
+/** Remove the white-space around an expression.
+ */
+[[nodiscard]] inline std::string trim_csp_expression(std::string_view str)
+{
+    while (not str.empty() and (str.front() == ' ' or str.front() == '\t' or str.front() == '\n')) {
+        str.remove_prefix(1);
+    }
+    while (not str.empty() and (str.back() == ' ' or str.back() == '\t' or str.back() == '\n')) {
+        str.remove_suffix(1);
+    }
+    return std::string{str};
+}
+
+/** Read an included template.
+ *
+ * @param path The path of the included template.
+ * @param error Set to the message of an error.
+ * @return The text of the included template.
+ */
+[[nodiscard]] inline std::string read_csp_include(std::filesystem::path const& path, std::string& error)
+{
+    auto f = std::ifstream(path);
+    if (not f.is_open()) {
+        error = std::format("Could not open included template {}.", path.string());
+        return {};
+    }
+    return std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+/** Skip the rest of a placeholder or directive after an error.
+ *
+ * @param first On return, pointing after the next '}' or at last.
+ * @param last Iterator pointing after the end of the template.
+ * @param line_nr The line-number, incremented for each skipped new-line.
+ */
+template<std::random_access_iterator It>
+constexpr void skip_csp_placeholder(It& first, It last, int& line_nr) noexcept
+{
+    for (; first != last; ++first) {
+        if (*first == '}') {
+            ++first;
+            return;
+        } else if (*first == '\n') {
+            ++line_nr;
+        }
+    }
+}
+
+/** The column of a position in a template.
+ *
+ * @param first Iterator to the first character of the template.
+ * @param position Iterator to the position.
+ * @return The column, starting at 1.
+ */
+template<std::random_access_iterator It>
+[[nodiscard]] constexpr int csp_column_nr(It first, It position) noexcept
+{
+    auto it = position;
+    while (it != first and *(it - 1) != '\n') {
+        --it;
+    }
+    return static_cast<int>(position - it) + 1;
+}
+
 } // namespace detail
 
+/** Parse a template into tokens.
+ *
+ * Include directives `${@include "path"}` are resolved here; the tokens of
+ * the included template are inserted between two `path` tokens.
+ *
+ * @param first Iterator to the first character of the template.
+ * @param last Iterator beyond the last character of the template.
+ * @param path The path of the template, used for error messages and to find included templates.
+ * @param config Options for parsing.
+ * @return A generator yielding tokens.
+ * @throws csp_error On the first error, unless `config.diagnostics` is set.
+ */
 template<std::random_access_iterator It>
-generator<csp_token<It>> parse_csp(It first, It last, std::filesystem::path const& path)
+generator<csp_token<It>> parse_csp(It first, It last, std::filesystem::path path, parse_csp_config config = {})
 {
+    constexpr auto max_include_depth = 64;
+
     int line_nr = 1;
+    auto in_text = config.start_in_text;
+
+    // The names of the directives that are not yet closed with @end.
+    auto open_blocks = std::vector<std::string>{};
+
+    auto const begin = first;
+    auto const report = [&](int error_line_nr, It position, std::string message) {
+        auto diagnostic = csp_diagnostic{path, error_line_nr, detail::csp_column_nr(begin, position), std::move(message)};
+        if (not config.diagnostics) {
+            throw csp_error(to_string(diagnostic));
+        }
+        config.diagnostics->push_back(std::move(diagnostic));
+    };
 
     while (first != last) {
-        if (auto const token = detail::parse_csp_verbatim(first, last, line_nr)) {
-            co_yield token;
+        if (in_text) {
+            in_text = false;
+        } else if (auto token = detail::parse_csp_verbatim(first, last, line_nr)) {
+            co_yield std::move(token);
         }
 
         while (first != last) {
             auto after = detail::parse_csp_after_text{};
-            if (auto const token = detail::parse_csp_text(first, last, line_nr, after)) {
-                co_yield token;
+            if (auto token = detail::parse_csp_text(first, last, line_nr, after)) {
+                co_yield std::move(token);
             }
 
             if (after == detail::parse_csp_after_text::verbatim) {
@@ -344,21 +523,136 @@ generator<csp_token<It>> parse_csp(It first, It last, std::filesystem::path cons
                 break;
 
             } else if (after == detail::parse_csp_after_text::line_verbatim) {
-                if (auto const token = detail::parse_csp_line_verbatim(first, last, line_nr)) {
-                    co_yield token;
+                if (auto token = detail::parse_csp_line_verbatim(first, last, line_nr)) {
+                    co_yield std::move(token);
                 }
 
             } else if (after == detail::parse_csp_after_text::text) {
                 // Continue parsing text, found an escape.
                 continue;
 
+            } else if (after == detail::parse_csp_after_text::placeholder and first != last and *first == '@') {
+                // Found directive
+                auto const directive_first = first;
+                auto const directive_line_nr = line_nr;
+                auto const name = detail::parse_csp_directive_name(++first, last);
+                auto error = std::string{};
+                auto const argument = detail::parse_csp_expression(first, last, line_nr, false, error);
+                if (not error.empty()) {
+                    report(line_nr, first, std::move(error));
+                    detail::skip_csp_placeholder(first, last, line_nr);
+                    continue;
+                }
+                if (first == last or *first != '}') {
+                    report(line_nr, first, std::format("Unexpected character in @{} directive.", name));
+                    detail::skip_csp_placeholder(first, last, line_nr);
+                    continue;
+                }
+                ++first;
+
+                if (name == "include") {
+                    if (config.include_depth == max_include_depth) {
+                        report(directive_line_nr, directive_first, "Include nesting is too deep.");
+                        continue;
+                    }
+
+                    auto include_path = path.parent_path() / detail::parse_csp_include_path(argument.text, error);
+                    if (not error.empty()) {
+                        report(directive_line_nr, directive_first, std::move(error));
+                        continue;
+                    }
+                    if (config.dependencies) {
+                        config.dependencies->push_back(include_path);
+                    }
+
+                    auto const include_text = detail::read_csp_include(include_path, error);
+                    if (not error.empty()) {
+                        report(directive_line_nr, directive_first, std::move(error));
+                        continue;
+                    }
+
+                    auto const include_view = std::string_view{include_text};
+                    auto include_config = config;
+                    include_config.start_in_text = true;
+                    ++include_config.include_depth;
+
+                    auto path_token = csp_token<It>{csp_token_type::path, 1};
+                    path_token.text = include_path.generic_string();
+                    co_yield std::move(path_token);
+
+                    for (auto& include_token :
+                         parse_csp(include_view.begin(), include_view.end(), include_path, include_config)) {
+                        auto token = csp_token<It>{include_token.kind, include_token.line_nr};
+                        token.text = std::move(include_token.text);
+                        co_yield std::move(token);
+                    }
+
+                    path_token = csp_token<It>{csp_token_type::path, line_nr};
+                    path_token.text = path.generic_string();
+                    co_yield std::move(path_token);
+
+                } else if (name == "cache") {
+                    // The block is opened even without a key, so that its @end is not reported as well.
+                    open_blocks.push_back(name);
+
+                    auto token = csp_token<It>{csp_token_type::cache, directive_line_nr};
+                    token.text = detail::trim_csp_expression(argument.text);
+                    if (token.text.empty()) {
+                        report(directive_line_nr, directive_first, "Expecting a key expression as argument of @cache.");
+                        continue;
+                    }
+                    co_yield std::move(token);
+
+                } else if (name == "end") {
+                    if (not detail::trim_csp_expression(argument.text).empty()) {
+                        report(directive_line_nr, directive_first, "Unexpected argument of @end.");
+                    }
+                    if (open_blocks.empty()) {
+                        report(directive_line_nr, directive_first, "Found @end without a matching directive.");
+                        continue;
+                    }
+                    open_blocks.pop_back();
+                    co_yield {csp_token_type::end, directive_line_nr};
+
+                } else if (name == "parallel") {
+                    open_blocks.push_back(name);
+
+                    auto token = csp_token<It>{csp_token_type::parallel, directive_line_nr};
+                    token.text = detail::trim_csp_expression(argument.text);
+                    if (token.text.empty()) {
+                        report(directive_line_nr, directive_first, "Expecting an executor as argument of @parallel.");
+                        continue;
+                    }
+                    co_yield std::move(token);
+
+                } else if (name == "section") {
+                    if (not detail::trim_csp_expression(argument.text).empty()) {
+                        report(directive_line_nr, directive_first, "Unexpected argument of @section.");
+                    }
+                    if (open_blocks.empty() or open_blocks.back() != "parallel") {
+                        report(directive_line_nr, directive_first, "Found @section outside of @parallel.");
+                        continue;
+                    }
+                    co_yield {csp_token_type::section, directive_line_nr};
+
+                } else if (name == "flush") {
+                    if (not detail::trim_csp_expression(argument.text).empty()) {
+                        report(directive_line_nr, directive_first, "Unexpected argument of @flush.");
+                    }
+                    co_yield {csp_token_type::flush, directive_line_nr};
+
+                } else {
+                    report(directive_line_nr, directive_first, std::format("Unknown directive @{}.", name));
+                }
+
             } else if (after == detail::parse_csp_after_text::placeholder) {
                 // Found placeholder
                 auto num_arguments = 0;
                 auto is_filter = false;
                 while (true) {
                     if (first == last) {
-                        throw csp_error(std::format("{}:{}: Incomplete placeholder found.", path.string(), line_nr));
+                        report(line_nr, first, "Incomplete placeholder found.");
+                        break;
 
                     } else if (*first == '}') {
                         if (is_filter) {
@@ -378,8 +672,15 @@ generator<csp_token<It>> parse_csp(It first, It last, std::filesystem::path cons
                         ++first;
 
                     } else {
-                        if (auto const token = detail::parse_csp_expression(first, last, path, line_nr, is_filter)) {
-                            co_yield token;
+                        auto error = std::string{};
+                        auto token = detail::parse_csp_expression(first, last, line_nr, is_filter, error);
+                        if (not error.empty()) {
+                            report(line_nr, first, std::move(error));
+                            detail::skip_csp_placeholder(first, last, line_nr);
+                            break;
+                        }
+                        if (token) {
+                            co_yield std::move(token);
                         }
                         is_filter = false;
                     }
@@ -390,11 +691,31 @@ generator<csp_token<It>> parse_csp(It first, It last, std::filesystem::path cons
             }
         }
     }
+
+    if (not open_blocks.empty()) {
+        report(line_nr, last, std::format("Missing @end for @{}.", open_blocks.back()));
+    }
 }
 
-auto parse_csp(std::string_view str, std::filesystem::path const& path)
+inline auto parse_csp(std::string_view str, std::filesystem::path const& path, parse_csp_config const& config = {})
 {
-    return parse_csp(str.begin(), str.end(), path);
+    return parse_csp(str.begin(), str.end(), path, config);
+}
+
+/** Check a template for errors, without throwing.
+ *
+ * @param str The text of the template.
+ * @param path The path of the template, used for the diagnostics and to find included templates.
+ * @param config Options for parsing.
+ * @return The errors found in the template and the templates it includes.
+ */
+[[nodiscard]] inline std::vector<csp_diagnostic>
+check_csp(std::string_view str, std::filesystem::path const& path, parse_csp_config config = {})
+{
+    auto r = std::vector<csp_diagnostic>{};
+    config.diagnostics = &r;
+    for ([[maybe_unused]] auto const& token : parse_csp(str, path, config)) {}
+    return r;
 }
 
 }} // namespace csp::v1
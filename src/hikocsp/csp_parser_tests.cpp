@@ -4,6 +4,8 @@
 
 #include "csp_parser.hpp"
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
 
 TEST(csp_parser, verbatim)
 {
@@ -291,3 +293,180 @@ TEST(csp_parser, example)
     ASSERT_EQ(it->text, "}\n");
     ASSERT_EQ(++it, tokens.end());
 }
+
+TEST(csp_parser, include)
+{
+    auto const dir = std::filesystem::temp_directory_path() / "hikocsp_csp_parser_tests";
+    std::filesystem::create_directories(dir);
+    {
+        auto f = std::ofstream(dir / "header.csp");
+        f << "head ${a}\n$}\n";
+    }
+
+    auto dependencies = std::vector<std::filesystem::path>{};
+    auto config = csp::parse_csp_config{};
+    config.dependencies = &dependencies;
+
+    auto s = std::string{"{{foo\n${@include \"header.csp\"}bar"};
+    auto tokens = csp::parse_csp(s, dir / "page.csp", config);
+    auto it = tokens.begin();
+
+    ASSERT_NE(it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "foo\n");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::path);
+    ASSERT_EQ(it->text, (dir / "header.csp").generic_string());
+    ASSERT_EQ(it->line_nr, 1);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "head ");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::placeholder_argument);
+    ASSERT_EQ(it->text, "a");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::placeholder_end);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "\n");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::verbatim);
+    ASSERT_EQ(it->text, "}\n");
+    ASSERT_EQ(it->line_nr, 2);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::path);
+    ASSERT_EQ(it->text, (dir / "page.csp").generic_string());
+    ASSERT_EQ(it->line_nr, 2);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "bar");
+    ASSERT_EQ(++it, tokens.end());
+
+    ASSERT_EQ(dependencies.size(), 1);
+    ASSERT_EQ(dependencies.front(), dir / "header.csp");
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(csp_parser, unknown_directive)
+{
+    auto s = std::string{"{{${@foo}"};
+    auto tokens = csp::parse_csp(s, "<none>");
+
+    ASSERT_THROW(
+        for (auto const& token : tokens) { (void)token; }, csp::csp_error);
+}
+
+TEST(csp_parser, cache_directive)
+{
+    auto s = std::string{"{{${@cache id}<b>${a}</b>${@end}"};
+    auto tokens = csp::parse_csp(s, "<none>");
+    auto it = tokens.begin();
+
+    ASSERT_NE(it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::cache);
+    ASSERT_EQ(it->text, "id");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "<b>");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::placeholder_argument);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::placeholder_end);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "</b>");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::end);
+    ASSERT_EQ(++it, tokens.end());
+}
+
+TEST(csp_parser, cache_directive_errors)
+{
+    auto const parse = [](std::string const& s) {
+        for (auto const& token : csp::parse_csp(s, "<none>")) {
+            (void)token;
+        }
+    };
+
+    ASSERT_THROW(parse("{{${@cache}${@end}"), csp::csp_error);
+    ASSERT_THROW(parse("{{${@cache id}foo"), csp::csp_error);
+    ASSERT_THROW(parse("{{foo${@end}"), csp::csp_error);
+    ASSERT_THROW(parse("{{${@cache id}foo${@end x}"), csp::csp_error);
+    ASSERT_NO_THROW(parse("{{${@cache a}${@cache b}foo${@end}${@end}"));
+}
+
+TEST(csp_parser, flush_directive)
+{
+    auto s = std::string{"{{<head></head>${@flush}<body>"};
+    auto tokens = csp::parse_csp(s, "<none>");
+    auto it = tokens.begin();
+
+    ASSERT_NE(it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "<head></head>");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::flush);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "<body>");
+    ASSERT_EQ(++it, tokens.end());
+
+    auto s2 = std::string{"{{${@flush now}"};
+    auto tokens2 = csp::parse_csp(s2, "<none>");
+    ASSERT_THROW(
+        for (auto const& token : tokens2) { (void)token; }, csp::csp_error);
+}
+
+TEST(csp_parser, parallel_directive)
+{
+    auto s = std::string{"{{${@parallel pool}a${@section}b${@end}"};
+    auto tokens = csp::parse_csp(s, "<none>");
+    auto it = tokens.begin();
+
+    ASSERT_NE(it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::parallel);
+    ASSERT_EQ(it->text, "pool");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "a");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::section);
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::text);
+    ASSERT_EQ(it->text, "b");
+    ASSERT_NE(++it, tokens.end());
+    ASSERT_EQ(it->kind, csp::csp_token_type::end);
+    ASSERT_EQ(++it, tokens.end());
+
+    auto const parse = [](std::string const& s) {
+        for (auto const& token : csp::parse_csp(s, "<none>")) {
+            (void)token;
+        }
+    };
+
+    ASSERT_THROW(parse("{{${@parallel}a${@end}"), csp::csp_error);
+    ASSERT_THROW(parse("{{a${@section}b"), csp::csp_error);
+    ASSERT_THROW(parse("{{${@parallel pool}${@cache id}${@section}${@end}${@end}"), csp::csp_error);
+    ASSERT_THROW(parse("{{${@parallel pool}a"), csp::csp_error);
+}
+
+TEST(csp_parser, diagnostics)
+{
+    auto const s = std::string{"{{a\n${@foo}\nb${x(]}c\n${@end}\n${y"};
+
+    auto const diagnostics = csp::check_csp(s, "<none>");
+    ASSERT_EQ(diagnostics.size(), 4);
+    ASSERT_EQ(diagnostics[0], (csp::csp_diagnostic{"<none>", 2, 3, "Unknown directive @foo."}));
+    ASSERT_EQ(diagnostics[1], (csp::csp_diagnostic{"<none>", 3, 6, "Unexpected ] when terminating subexpression, expecting )."}));
+    ASSERT_EQ(diagnostics[2], (csp::csp_diagnostic{"<none>", 4, 3, "Found @end without a matching directive."}));
+    ASSERT_EQ(diagnostics[3], (csp::csp_diagnostic{"<none>", 5, 4, "Unexpected EOF parsing C++ expression."}));
+    ASSERT_EQ(to_string(diagnostics[0]), "<none>:2:3: Unknown directive @foo.");
+
+    ASSERT_TRUE(csp::check_csp("{{${@cache id}${a}${@end}", "<none>").empty());
+
+    // Without diagnostics the first error is thrown.
+    auto tokens = csp::parse_csp(s, "<none>");
+    ASSERT_THROW(
+        for (auto const& token : tokens) { (void)token; }, csp::csp_error);
+}
@@ -5,10 +5,67 @@
 #pragma once
 
 #include <iterator>
+#include <string_view>
 
 namespace csp { inline namespace v1 {
 
-enum class csp_token_type { verbatim, placeholder_argument, placeholder_filter, placeholder_end, text };
+/** The type of a token.
+ *
+ * A `path` token is emitted when the tokens that follow come from a different file,
+ * for example from an included template. The `text` of this token is the path of
+ * the file, and `line_nr` the line in that file where the following tokens start.
+ *
+ * A `cache` token starts a region that is cached, the `text` of this token is the
+ * key expression. An `end` token closes the region.
+ *
+ * A `flush` token marks the point where the output so far should be sent.
+ *
+ * A `parallel` token starts a region of sections that are rendered concurrently,
+ * the `text` of this token is the executor expression. Each `section` token
+ * starts the next section, an `end` token closes the region.
+ */
+enum class csp_token_type {
+    verbatim,
+    placeholder_argument,
+    placeholder_filter,
+    placeholder_end,
+    text,
+    path,
+    cache,
+    end,
+    flush,
+    parallel,
+    section
+};
+
+[[nodiscard]] constexpr std::string_view to_string(csp_token_type kind) noexcept
+{
+    switch (kind) {
+    case csp_token_type::verbatim:
+        return "verbatim";
+    case csp_token_type::placeholder_argument:
+        return "placeholder_argument";
+    case csp_token_type::placeholder_filter:
+        return "placeholder_filter";
+    case csp_token_type::placeholder_end:
+        return "placeholder_end";
+    case csp_token_type::text:
+        return "text";
+    case csp_token_type::path:
+        return "path";
+    case csp_token_type::cache:
+        return "cache";
+    case csp_token_type::end:
+        return "end";
+    case csp_token_type::flush:
+        return "flush";
+    case csp_token_type::parallel:
+        return "parallel";
+    case csp_token_type::section:
+        return "section";
+    }
+    return "unknown";
+}
 
 template<std::random_access_iterator It>
 struct csp_token {
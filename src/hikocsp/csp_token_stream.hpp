@@ -0,0 +1,354 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "csp_token.hpp"
+#include "csp_error.hpp"
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <iterator>
+#include <format>
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+/** A token in a serialized token-stream.
+ *
+ * The text refers into the token-stream's string-table.
+ */
+struct csp_token_view {
+    std::string_view text;
+    int line_nr = 0;
+    csp_token_type kind = csp_token_type::verbatim;
+
+    [[nodiscard]] constexpr bool empty() const noexcept
+    {
+        return text.empty();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return not empty();
+    }
+};
+
+namespace detail {
+
+constexpr auto csp_token_stream_magic = std::string_view{"CSPT"};
+constexpr uint32_t csp_token_stream_version = 1;
+
+/** The size of the header: magic, version, token-count, string-table size, path offset and path length.
+ */
+constexpr std::size_t csp_token_stream_header_size = 24;
+
+/** The size of a token record: kind, line-number, text offset and text length.
+ */
+constexpr std::size_t csp_token_stream_record_size = 16;
+
+inline void append_uint32(std::string& r, uint32_t value)
+{
+    for (auto i = 0; i != 4; ++i) {
+        r += static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+[[nodiscard]] constexpr uint32_t load_uint32(char const *ptr) noexcept
+{
+    auto r = uint32_t{0};
+    for (auto i = 3; i >= 0; --i) {
+        r <<= 8;
+        r |= static_cast<uint8_t>(ptr[i]);
+    }
+    return r;
+}
+
+} // namespace detail
+
+/** Serialize tokens into the binary token-stream format.
+ *
+ * The format consists of three parts, all integers are 32 bit little-endian:
+ *  - Header: "CSPT", version, number of tokens, size of the string-table,
+ *    offset and length of the template's path in the string-table.
+ *  - Token records: kind, line-number, offset and length of the text in
+ *    the string-table.
+ *  - String-table: the text of the tokens, identical texts are stored once.
+ *
+ * @param first An iterator to the first token, as returned from `parse_csp()`.
+ * @param last A sentinel beyond the last token.
+ * @param path The path of the template.
+ * @return The token-stream.
+ */
+template<std::input_iterator It, std::sentinel_for<It> ItEnd>
+[[nodiscard]] std::string serialize_csp_tokens(It first, ItEnd last, std::filesystem::path const& path)
+{
+    auto string_table = std::string{};
+    auto string_offsets = std::map<std::string, uint32_t, std::less<>>{};
+    auto const add_string = [&](std::string_view str) -> uint32_t {
+        if (auto it = string_offsets.find(str); it != string_offsets.end()) {
+            return it->second;
+        }
+        auto const offset = static_cast<uint32_t>(string_table.size());
+        string_table += str;
+        string_offsets.emplace(str, offset);
+        return offset;
+    };
+
+    auto const path_str = path.generic_string();
+    auto const path_offset = add_string(path_str);
+
+    auto records = std::string{};
+    auto count = uint32_t{0};
+    for (auto it = first; it != last; ++it) {
+        auto const& token = *it;
+        auto const text = std::string_view{token.text};
+        detail::append_uint32(records, static_cast<uint32_t>(token.kind));
+        detail::append_uint32(records, static_cast<uint32_t>(token.line_nr));
+        detail::append_uint32(records, add_string(text));
+        detail::append_uint32(records, static_cast<uint32_t>(text.size()));
+        ++count;
+    }
+
+    auto r = std::string{detail::csp_token_stream_magic};
+    detail::append_uint32(r, detail::csp_token_stream_version);
+    detail::append_uint32(r, count);
+    detail::append_uint32(r, static_cast<uint32_t>(string_table.size()));
+    detail::append_uint32(r, path_offset);
+    detail::append_uint32(r, static_cast<uint32_t>(path_str.size()));
+    r += records;
+    r += string_table;
+    return r;
+}
+
+/** A view on a serialized token-stream.
+ *
+ * The data is validated when the view is constructed, after that iterating
+ * over the tokens does not allocate, which makes it suitable for use on a
+ * memory-mapped file.
+ *
+ * The view does not own the data.
+ */
+class csp_token_stream {
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = csp_token_view;
+        using difference_type = std::ptrdiff_t;
+        using reference = csp_token_view;
+
+        constexpr const_iterator() noexcept = default;
+
+        constexpr const_iterator(csp_token_stream const *stream, std::size_t index) noexcept : _stream(stream), _index(index) {}
+
+        [[nodiscard]] reference operator*() const noexcept
+        {
+            return (*_stream)[_index];
+        }
+
+        [[nodiscard]] reference operator[](difference_type n) const noexcept
+        {
+            return (*_stream)[_index + n];
+        }
+
+        constexpr const_iterator& operator++() noexcept
+        {
+            ++_index;
+            return *this;
+        }
+
+        constexpr const_iterator operator++(int) noexcept
+        {
+            auto tmp = *this;
+            ++_index;
+            return tmp;
+        }
+
+        constexpr const_iterator& operator--() noexcept
+        {
+            --_index;
+            return *this;
+        }
+
+        constexpr const_iterator operator--(int) noexcept
+        {
+            auto tmp = *this;
+            --_index;
+            return tmp;
+        }
+
+        constexpr const_iterator& operator+=(difference_type n) noexcept
+        {
+            _index += n;
+            return *this;
+        }
+
+        constexpr const_iterator& operator-=(difference_type n) noexcept
+        {
+            _index -= n;
+            return *this;
+        }
+
+        [[nodiscard]] constexpr friend const_iterator operator+(const_iterator lhs, difference_type rhs) noexcept
+        {
+            return lhs += rhs;
+        }
+
+        [[nodiscard]] constexpr friend const_iterator operator+(difference_type lhs, const_iterator rhs) noexcept
+        {
+            return rhs += lhs;
+        }
+
+        [[nodiscard]] constexpr friend const_iterator operator-(const_iterator lhs, difference_type rhs) noexcept
+        {
+            return lhs -= rhs;
+        }
+
+        [[nodiscard]] constexpr friend difference_type operator-(const_iterator const& lhs, const_iterator const& rhs) noexcept
+        {
+            return static_cast<difference_type>(lhs._index) - static_cast<difference_type>(rhs._index);
+        }
+
+        [[nodiscard]] constexpr friend bool operator==(const_iterator const& lhs, const_iterator const& rhs) noexcept
+        {
+            return lhs._index == rhs._index;
+        }
+
+        [[nodiscard]] constexpr friend auto operator<=>(const_iterator const& lhs, const_iterator const& rhs) noexcept
+        {
+            return lhs._index <=> rhs._index;
+        }
+
+    private:
+        csp_token_stream const *_stream = nullptr;
+        std::size_t _index = 0;
+    };
+
+    /** Open a token-stream.
+     *
+     * @param data The serialized token-stream.
+     * @throws csp_error When the data is not a valid token-stream.
+     */
+    explicit csp_token_stream(std::string_view data) : _data(data)
+    {
+        using namespace detail;
+
+        if (not _data.starts_with(csp_token_stream_magic) or _data.size() < csp_token_stream_header_size) {
+            throw csp_error("Not a hikocsp token-stream.");
+        }
+
+        if (auto const version = load_uint32(_data.data() + 4); version != csp_token_stream_version) {
+            throw csp_error(std::format("Unsupported token-stream version {}, expected {}.", version, csp_token_stream_version));
+        }
+
+        _size = load_uint32(_data.data() + 8);
+        auto const string_table_size = load_uint32(_data.data() + 12);
+        auto const string_table_offset = csp_token_stream_header_size + _size * csp_token_stream_record_size;
+        if (_data.size() != string_table_offset + string_table_size) {
+            throw csp_error("Token-stream has an incorrect size.");
+        }
+        _string_table = _data.substr(string_table_offset);
+
+        _path = string(load_uint32(_data.data() + 16), load_uint32(_data.data() + 20));
+
+        // The open @cache and @parallel directives; checked here so that the
+        // translator never sees a @section or @end without its directive.
+        auto blocks = std::vector<csp_token_type>{};
+        for (auto i = std::size_t{0}; i != _size; ++i) {
+            auto const record = _data.data() + csp_token_stream_header_size + i * csp_token_stream_record_size;
+            auto const kind = load_uint32(record);
+            if (kind > static_cast<uint32_t>(csp_token_type::section)) {
+                throw csp_error(std::format("Token-stream has a token of unknown kind {}.", kind));
+            }
+            [[maybe_unused]] auto const text = string(load_uint32(record + 8), load_uint32(record + 12));
+
+            switch (static_cast<csp_token_type>(kind)) {
+            case csp_token_type::cache:
+            case csp_token_type::parallel:
+                blocks.push_back(static_cast<csp_token_type>(kind));
+                break;
+            case csp_token_type::section:
+                if (blocks.empty() or blocks.back() != csp_token_type::parallel) {
+                    throw csp_error("Token-stream has unbalanced directives.");
+                }
+                break;
+            case csp_token_type::end:
+                if (blocks.empty()) {
+                    throw csp_error("Token-stream has unbalanced directives.");
+                }
+                blocks.pop_back();
+                break;
+            default:;
+            }
+        }
+        if (not blocks.empty()) {
+            throw csp_error("Token-stream has unbalanced directives.");
+        }
+    }
+
+    /** The path of the template.
+     */
+    [[nodiscard]] std::string_view path() const noexcept
+    {
+        return _path;
+    }
+
+    /** The number of tokens.
+     */
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    [[nodiscard]] csp_token_view operator[](std::size_t index) const noexcept
+    {
+        using namespace detail;
+
+        auto const record = _data.data() + csp_token_stream_header_size + index * csp_token_stream_record_size;
+        return csp_token_view{
+            _string_table.substr(load_uint32(record + 8), load_uint32(record + 12)),
+            static_cast<int>(load_uint32(record + 4)),
+            static_cast<csp_token_type>(load_uint32(record))};
+    }
+
+    [[nodiscard]] const_iterator begin() const noexcept
+    {
+        return const_iterator{this, 0};
+    }
+
+    [[nodiscard]] const_iterator end() const noexcept
+    {
+        return const_iterator{this, _size};
+    }
+
+private:
+    std::string_view _data;
+    std::string_view _string_table;
+    std::string_view _path;
+    std::size_t _size = 0;
+
+    /** Get a string from the string-table, with bounds checking.
+     */
+    [[nodiscard]] std::string_view string(uint32_t offset, uint32_t length) const
+    {
+        if (offset > _string_table.size() or length > _string_table.size() - offset) {
+            throw csp_error("Token-stream has a text outside the string-table.");
+        }
+        return _string_table.substr(offset, length);
+    }
+};
+
+static_assert(std::random_access_iterator<csp_token_stream::const_iterator>);
+
+}} // namespace csp::v1
@@ -0,0 +1,114 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "csp_token_stream.hpp"
+#include "csp_translator.hpp"
+#include "csp_parser.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace csp_token_stream_tests {
+
+constexpr auto example =
+    "void foo(int x) {{{\n"
+    "<h1>${x}</h1>\n"
+    "<p>${x, \"{:x}\" | `reverse}</p>\n"
+    "}}}\n";
+
+template<typename It, typename ItEnd>
+[[nodiscard]] std::string translate(It first, ItEnd last, std::filesystem::path const& path)
+{
+    auto r = std::string{};
+    for (auto const& s : csp::translate_csp(first, last, path, csp::translate_csp_config{})) {
+        r += s;
+    }
+    return r;
+}
+
+} // namespace csp_token_stream_tests
+
+TEST(csp_token_stream, round_trip)
+{
+    auto tokens = std::vector<csp::csp_token<std::string_view::const_iterator>>{};
+    for (auto&& token : csp::parse_csp(csp_token_stream_tests::example, "example.csp")) {
+        tokens.push_back(std::move(token));
+    }
+
+    auto const data = csp::serialize_csp_tokens(tokens.begin(), tokens.end(), "example.csp");
+    auto const stream = csp::csp_token_stream{data};
+
+    ASSERT_EQ(stream.path(), "example.csp");
+    ASSERT_EQ(stream.size(), tokens.size());
+    for (auto i = std::size_t{0}; i != tokens.size(); ++i) {
+        ASSERT_EQ(stream[i].text, tokens[i].text);
+        ASSERT_EQ(stream[i].line_nr, tokens[i].line_nr);
+        ASSERT_EQ(stream[i].kind, tokens[i].kind);
+    }
+}
+
+TEST(csp_token_stream, string_table)
+{
+    auto tokens = std::vector<csp::csp_token<std::string_view::const_iterator>>(3);
+    tokens[0].text = "foo";
+    tokens[1].text = "bar";
+    tokens[2].text = "foo";
+
+    auto const data = csp::serialize_csp_tokens(tokens.begin(), tokens.end(), "foo");
+    ASSERT_EQ(data.size(), 24 + 3 * 16 + 6);
+    ASSERT_TRUE(data.ends_with("foobar"));
+
+    auto const stream = csp::csp_token_stream{data};
+    ASSERT_EQ(stream.path(), "foo");
+    ASSERT_EQ(stream[2].text, "foo");
+}
+
+TEST(csp_token_stream, translate)
+{
+    auto tokens = csp::parse_csp(csp_token_stream_tests::example, "example.csp");
+    auto const data = csp::serialize_csp_tokens(tokens.begin(), tokens.end(), "example.csp");
+    auto const stream = csp::csp_token_stream{data};
+
+    auto tokens2 = csp::parse_csp(csp_token_stream_tests::example, "example.csp");
+    ASSERT_EQ(
+        csp_token_stream_tests::translate(stream.begin(), stream.end(), stream.path()),
+        csp_token_stream_tests::translate(tokens2.begin(), tokens2.end(), "example.csp"));
+}
+
+TEST(csp_token_stream, invalid)
+{
+    auto tokens = csp::parse_csp(csp_token_stream_tests::example, "example.csp");
+    auto const data = csp::serialize_csp_tokens(tokens.begin(), tokens.end(), "example.csp");
+
+    ASSERT_THROW(csp::csp_token_stream{""}, csp::csp_error);
+    ASSERT_THROW(csp::csp_token_stream{"CSPX" + data.substr(4)}, csp::csp_error);
+    ASSERT_THROW(csp::csp_token_stream{data.substr(0, data.size() - 1)}, csp::csp_error);
+
+    auto wrong_version = data;
+    wrong_version[4] = 2;
+    ASSERT_THROW(csp::csp_token_stream{wrong_version}, csp::csp_error);
+
+    // The text of the first token points outside of the string-table.
+    auto wrong_offset = data;
+    wrong_offset[24 + 11] = 0x7f;
+    ASSERT_THROW(csp::csp_token_stream{wrong_offset}, csp::csp_error);
+}
+
+TEST(csp_token_stream, unbalanced)
+{
+    auto const serialize = [](std::vector<csp::csp_token_type> const& kinds) {
+        auto tokens = std::vector<csp::csp_token<std::string_view::iterator>>{};
+        for (auto const kind : kinds) {
+            tokens.emplace_back(kind, 1);
+        }
+        return csp::serialize_csp_tokens(tokens.begin(), tokens.end(), "example.csp");
+    };
+
+    using enum csp::csp_token_type;
+    ASSERT_NO_THROW(csp::csp_token_stream{serialize({parallel, section, cache, end, section, end})});
+    ASSERT_THROW(csp::csp_token_stream{serialize({end})}, csp::csp_error);
+    ASSERT_THROW(csp::csp_token_stream{serialize({section})}, csp::csp_error);
+    ASSERT_THROW(csp::csp_token_stream{serialize({cache, section, end})}, csp::csp_error);
+    ASSERT_THROW(csp::csp_token_stream{serialize({parallel, section})}, csp::csp_error);
+}
@@ -5,6 +5,8 @@
 #pragma once
 
 #include "csp_token.hpp"
+#include "csp_ir.hpp"
+#include "csp_error.hpp"
 #include "generator.hpp"
 #include <filesystem>
 #include <string>
@@ -14,10 +16,25 @@
 #include <ranges>
 #include <iterator>
 #include <optional>
+#include <set>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#if defined(__SSE2__) or defined(_M_X64) or defined(_M_AMD64)
+#include <emmintrin.h>
+#define HIKOCSP_HAS_SSE2 1
+#endif
 
 namespace csp { inline namespace v1 {
+namespace detail {
 
-std::string encode_string_literal(std::string_view str)
+/** Encode a string into the content of a C++ string-literal.
+ *
+ * This is the straightforward implementation which handles a single character
+ * at a time. It is kept as a reference for `encode_string_literal()`.
+ */
+[[nodiscard]] inline std::string encode_string_literal_reference(std::string_view str)
 {
     auto r = std::string{};
     // Expect ASCII + \n at end.
@@ -102,15 +119,309 @@ std::string encode_string_literal(std::string_view str)
     return r;
 }
 
+/** Check if a character can be copied as-is into a C++ string-literal.
+ */
+[[nodiscard]] constexpr bool is_plain_string_literal_char(char c) noexcept
+{
+    return c >= 0x20 and c <= 0x7e and c != '"' and c != '\\' and c != '$' and c != '@' and c != '`';
+}
+
+/** Find the first character that needs to be escaped in a C++ string-literal.
+ *
+ * @param first Pointer to the first character.
+ * @param size The number of characters.
+ * @return The index of the first character to escape, or @a size if there is none.
+ */
+[[nodiscard]] inline std::size_t find_string_literal_escape(char const *first, std::size_t size) noexcept
+{
+    auto i = std::size_t{0};
+
+#if HIKOCSP_HAS_SSE2
+    auto const space_minus_one = _mm_set1_epi8(0x1f);
+    auto const delete_char = _mm_set1_epi8(0x7f);
+    auto const double_quote = _mm_set1_epi8('"');
+    auto const backslash = _mm_set1_epi8('\\');
+    auto const dollar = _mm_set1_epi8('$');
+    auto const at = _mm_set1_epi8('@');
+    auto const backtick = _mm_set1_epi8('`');
+
+    for (; i + 16 <= size; i += 16) {
+        auto const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(first + i));
+
+        // The comparisons are signed, so that characters >= 0x80 are less than 0x1f.
+        auto const printable = _mm_and_si128(_mm_cmpgt_epi8(chunk, space_minus_one), _mm_cmplt_epi8(chunk, delete_char));
+        auto const special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, double_quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(chunk, dollar), _mm_or_si128(_mm_cmpeq_epi8(chunk, at), _mm_cmpeq_epi8(chunk, backtick))));
+
+        auto const escape_mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_andnot_si128(special, printable))) ^ 0xffff;
+        if (escape_mask != 0) {
+            return i + std::countr_zero(escape_mask);
+        }
+    }
+#endif
+
+    for (; i != size; ++i) {
+        if (not is_plain_string_literal_char(first[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+/** Encode a single character into a C++ string-literal.
+ *
+ * @param r The string-literal to append to.
+ * @param c The character to encode.
+ * @param[in,out] x_escape Set when the previous character was encoded as a hex-escape.
+ */
+inline void encode_string_literal_char(std::string& r, char c, bool& x_escape)
+{
+    constexpr auto hex_digits = std::string_view{"0123456789abcdef"};
+
+    switch (c) {
+    case '"':
+        r += "\\\"";
+        break;
+    case '\\':
+        r += "\\\\";
+        break;
+    case '\a':
+        r += "\\a";
+        break;
+    case '\b':
+        r += "\\b";
+        break;
+    case '\f':
+        r += "\\f";
+        break;
+    case '\n':
+        r += "\\n";
+        break;
+    case '\r':
+        r += "\\r";
+        break;
+    case '\t':
+        r += "\\t";
+        break;
+    case '\v':
+        r += "\\v";
+        break;
+    default:
+        if (not is_plain_string_literal_char(c)) {
+            // Not part of the C++20 basic character set.
+            auto const u = static_cast<uint8_t>(c);
+            char const escape[] = {'\\', 'x', hex_digits[u >> 4], hex_digits[u & 0xf]};
+            r.append(escape, sizeof(escape));
+            x_escape = true;
+            return;
+        }
+
+        if (x_escape and ((c >= '0' and c <= '9') or (c >= 'a' and c <= 'f') or (c >= 'A' and c <= 'F'))) {
+            // x-escape sequence doesn't stop until a non-hex character is found.
+            // Use double-quote doubling to terminate.
+            r += "\"\"";
+        }
+        r += c;
+    }
+
+    x_escape = false;
+}
+
+} // namespace detail
+
+/** Encode a string into the content of a C++ string-literal.
+ *
+ * Runs of characters that do not need escaping are found using SIMD
+ * instructions and copied in bulk. Only the characters that need to be
+ * escaped, or directly follow a hex-escape, are handled one at a time.
+ *
+ * @param str The string to encode.
+ * @return The content of a string-literal, without the surrounding quotes.
+ */
+[[nodiscard]] inline std::string encode_string_literal(std::string_view str)
+{
+    auto r = std::string{};
+    // Expect mostly ASCII, with a few escapes.
+    r.reserve(str.size() + str.size() / 8 + 2);
+
+    auto x_escape = false;
+    auto i = std::size_t{0};
+    while (i != str.size()) {
+        if (not x_escape) {
+            auto const n = detail::find_string_literal_escape(str.data() + i, str.size() - i);
+            r.append(str.data() + i, n);
+            if ((i += n) == str.size()) {
+                break;
+            }
+        }
+
+        detail::encode_string_literal_char(r, str[i++], x_escape);
+    }
+
+    return r;
+}
+
+/** A pool of static template-text.
+ *
+ * All static text of one or more templates is concatenated into a single
+ * character array. Text that already appears in the pool is not added again,
+ * instead it is referenced by offset and length.
+ */
+class csp_text_pool {
+public:
+    csp_text_pool(csp_text_pool const&) = default;
+    csp_text_pool(csp_text_pool&&) noexcept = default;
+    csp_text_pool& operator=(csp_text_pool const&) = default;
+    csp_text_pool& operator=(csp_text_pool&&) noexcept = default;
+
+    /** Create a text-pool.
+     *
+     * @param name The name of the character array in the generated code.
+     */
+    explicit csp_text_pool(std::string name) noexcept : _name(std::move(name)), _text() {}
+
+    [[nodiscard]] std::string const& name() const noexcept
+    {
+        return _name;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _text.empty();
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return _text.size();
+    }
+
+    /** Add text to the pool.
+     *
+     * @param str The text to add.
+     * @return The offset of the text in the pool.
+     */
+    std::size_t insert(std::string_view str) noexcept
+    {
+        if (auto const i = _text.find(str); i != _text.npos) {
+            return i;
+        }
+
+        auto const r = _text.size();
+        _text += str;
+        return r;
+    }
+
+    /** Generate an expression that references text in the pool.
+     *
+     * @param str The text to reference, it is added to the pool if needed.
+     * @return A C++ expression resulting in a `std::string_view`.
+     */
+    [[nodiscard]] std::string reference(std::string_view str) noexcept
+    {
+        return std::format("std::string_view{{{} + {}, {}}}", _name, insert(str), str.size());
+    }
+
+    /** Generate the definition of the character array.
+     */
+    [[nodiscard]] std::string declaration() const noexcept
+    {
+        auto r = std::format("static constexpr char {}[] =", _name);
+
+        auto prev_i = size_t{};
+        auto i = _text.find('\n');
+        while (i != _text.npos) {
+            ++i;
+            r += std::format("\n  \"{}\"", encode_string_literal(std::string_view{_text}.substr(prev_i, i - prev_i)));
+            i = _text.find('\n', prev_i = i);
+        }
+
+        if (prev_i != _text.size() or _text.empty()) {
+            r += std::format("\n  \"{}\"", encode_string_literal(std::string_view{_text}.substr(prev_i)));
+        }
+
+        r += ";\n";
+        return r;
+    }
+
+private:
+    std::string _name;
+    std::string _text;
+};
+
+/** Counts of the code generated by `translate_csp()`.
+ */
+struct translate_csp_statistics {
+    /** The number of outputs; yields, calls to the callback or appends.
+     */
+    std::size_t num_outputs = 0;
+
+    /** The number of placeholders, each formatted with `std::format()`.
+     */
+    std::size_t num_format_calls = 0;
+};
+
 struct translate_csp_config {
     bool enable_line;
     std::optional<std::string> callback_name;
     std::optional<std::string> append_name;
+
+    /** Generate a resumable state-machine appending to a csp::resumable_buffer with this name.
+     */
+    std::optional<std::string> resumable_name;
+
+    /** Pool the static text in a single character array with this name.
+     */
+    std::optional<std::string> text_pool_name;
+
+    /** The template must be static, its text is declared as a `std::string_view` with this name.
+     */
+    std::optional<std::string> static_name;
+
+    /** Generate a module interface unit for a module with this name, exporting the template's functions.
+     */
+    std::optional<std::string> module_name;
+
+    /** The names of the optimization passes to skip, see `csp_passes`.
+     */
+    std::set<std::string, std::less<>> disabled_passes = {};
+
+    /** The names of the optimization passes to run that are not enabled by default, see `csp_passes`.
+     */
+    std::set<std::string, std::less<>> enabled_passes = {};
+
+    /** The name of the csp::fragment_cache used by `${@cache key}` regions.
+     */
+    std::string fragment_cache_name = "fragment_cache";
+
+    /** The name of the function called at `${@flush}` points.
+     */
+    std::optional<std::string> flush_name;
+
+    /** Measure each piece of text and placeholder with a csp::profile_site.
+     */
+    bool instrument = false;
+
+    /** When set, the counts of the generated code are added to these statistics.
+     */
+    translate_csp_statistics *statistics = nullptr;
 };
 
-[[nodiscard]] inline std::string translate_csp_yield(std::string_view str, translate_csp_config const& config) noexcept
+/** Translate the output of a piece of text.
+ *
+ * @param str The C++ expression of the text.
+ * @param config Options for translation.
+ * @param resume_point A unique number for the point after the output, used by
+ *                     resumable templates.
+ */
+[[nodiscard]] inline std::string
+translate_csp_yield(std::string_view str, translate_csp_config const& config, int resume_point = 0) noexcept
 {
-    if (config.callback_name) {
+    if (config.resumable_name) {
+        return std::format(
+            "if (not {0}.append({1})) return {0}.suspend({2});\n[[fallthrough]];\ncase {2}:;\n", *config.resumable_name, str, resume_point);
+    } else if (config.callback_name) {
         return std::format("{}({});\n", *config.callback_name, str);
     } else if (config.append_name) {
         return std::format("{} += {};\n", *config.append_name, str);
@@ -119,6 +430,54 @@ struct translate_csp_config {
     }
 }
 
+/** Wrap the output of text or a placeholder with a csp::profile_site.
+ *
+ * The site is a static variable inside a lambda, so that the output is still a
+ * single expression.
+ *
+ * @param str The C++ expression of the output.
+ * @param path The path of the template.
+ * @param line_nr The line in the template.
+ * @param kind The kind of output: "text", "escape" or "placeholder"; the
+ *             rendering time is only measured for placeholders.
+ */
+[[nodiscard]] inline std::string
+translate_csp_instrument(std::string_view str, std::string_view path, int line_nr, std::string_view kind) noexcept
+{
+    auto const site = std::format(
+        "static auto csp_site = csp::profile_site{{\"{}\", {}, \"{}\"}};", encode_string_literal(path), line_nr, kind);
+
+    if (kind == "placeholder") {
+        return std::format("([&] {{ {} return csp_site.measure([&] {{ return {}; }}); }})()", site, str);
+    } else {
+        return std::format("([&] {{ {} return csp_site.count({}); }})()", site, str);
+    }
+}
+
+/** Translate a flush point.
+ *
+ * A resumable template returns the partly filled buffer. In append mode the
+ * output so far is passed to the flush function and cleared, otherwise the
+ * flush function is called without arguments.
+ *
+ * @param config Options for translation.
+ * @param resume_point A unique number for the point after the flush, used by resumable templates.
+ * @return The code, or std::nullopt when there is nothing to flush.
+ */
+[[nodiscard]] inline std::optional<std::string> translate_csp_flush(translate_csp_config const& config, int resume_point) noexcept
+{
+    if (config.resumable_name) {
+        // Returning an empty buffer would mean that the template has finished.
+        return std::format("if ({0}.size() != 0) return {0}.suspend({1});\n[[fallthrough]];\ncase {1}:;\n", *config.resumable_name, resume_point);
+    } else if (not config.flush_name) {
+        return std::nullopt;
+    } else if (config.append_name and not config.callback_name) {
+        return std::format("{0}({1});\n{1}.clear();\n", *config.flush_name, *config.append_name);
+    } else {
+        return std::format("{}();\n", *config.flush_name);
+    }
+}
+
 [[nodiscard]] inline std::optional<std::string>
 translate_csp_path(std::filesystem::path const& path, translate_csp_config const& config) noexcept
 {
@@ -129,6 +488,16 @@ translate_csp_path(std::filesystem::path const& path, translate_csp_config const
     }
 }
 
+template<typename Token>
+[[nodiscard]] std::optional<std::string> translate_csp_file(Token const& token, translate_csp_config const& config) noexcept
+{
+    if (config.enable_line) {
+        return std::format("#line {} \"{}\"\n", token.line_nr, token.text);
+    } else {
+        return std::nullopt;
+    }
+}
+
 template<typename Token>
 [[nodiscard]] std::optional<std::string> translate_csp_line(Token const& token, translate_csp_config const& config) noexcept
 {
@@ -139,142 +508,675 @@ template<typename Token>
     }
 }
 
-template<std::input_iterator It, std::sentinel_for<It> ItEnd>
-[[nodiscard]] generator<std::string>
-translate_csp(It first, ItEnd last, std::filesystem::path const& path, translate_csp_config const& config) noexcept
+/** Translate template-text into a string-literal.
+ *
+ * Multi-line text is split into multiple concatenated string-literals,
+ * one for each line.
+ */
+[[nodiscard]] inline std::string translate_csp_text(std::string_view text) noexcept
+{
+    auto const num_lines = std::count(text.begin(), text.end(), '\n');
+    if (num_lines == 0 or (num_lines == 1 and text.back() == '\n')) {
+        // Only one line.
+        return std::format("\"{}\"", encode_string_literal(text));
+    }
+
+    auto r = std::string{};
+
+    auto prev_i = size_t{};
+    auto i = text.find('\n');
+    while (i != text.npos) {
+        ++i;
+
+        if (prev_i != 0) {
+            r += "\n  ";
+        }
+        r += std::format("\"{}\"", encode_string_literal(text.substr(prev_i, i - prev_i)));
+
+        i = text.find('\n', prev_i = i);
+    }
+
+    if (prev_i != text.size()) {
+        r += std::format("\n  \"{}\"", encode_string_literal(text.substr(prev_i)));
+    }
+    return r;
+}
+
+/** Generate the definition of the text of a static template.
+ *
+ * The definition is placed after the template's preamble, inside the include
+ * guard of a header template.
+ *
+ * @param name The name of the `std::string_view` constant.
+ * @param text The text of the template.
+ */
+[[nodiscard]] inline std::string translate_csp_static(std::string_view name, std::string_view text) noexcept
+{
+    return std::format(
+        "#include <string_view>\nstatic constexpr auto {} = std::string_view{{\n  {}, {}}};\n", name, translate_csp_text(text), text.size());
+}
+
+/** Generate the declaration of a module.
+ *
+ * The module re-exports the `hikocsp` module, so that the code importing the
+ * templates can name `csp::generator` and the other types of the template's
+ * functions.
+ *
+ * @param name The name of the module.
+ */
+[[nodiscard]] inline std::string translate_csp_module(std::string_view name) noexcept
+{
+    return std::format("export module {};\nexport import hikocsp;\n", name);
+}
+
+namespace detail {
+
+/** Split the preamble from the start of a template.
+ *
+ * The preamble are the preprocessor directives, comments and empty lines at
+ * the start of the verbatim C++ code, like the `#include` directives. In a
+ * module the preamble is placed in the global module fragment.
+ *
+ * @param ir The IR of the template, the preamble is removed from it.
+ * @return The preamble.
+ */
+[[nodiscard]] inline std::string split_csp_preamble(csp_ir& ir) noexcept
+{
+    if (ir.empty() or ir.front().kind != csp_ir_kind::verbatim) {
+        return {};
+    }
+
+    auto& node = ir.front();
+    auto const text = std::string_view{node.text};
+
+    auto end = std::size_t{0};
+    auto continuation = false;
+    for (auto i = text.find('\n'); i != text.npos; i = text.find('\n', end)) {
+        auto const line = text.substr(end, i - end);
+        auto const first = line.find_first_not_of(" \t\r");
+        auto const last = line.find_last_not_of(" \t\r");
+        auto const trimmed = first == line.npos ? std::string_view{} : line.substr(first, last - first + 1);
+
+        if (not continuation and not trimmed.empty() and not trimmed.starts_with('#') and not trimmed.starts_with("//")) {
+            break;
+        }
+
+        // A directive or comment is continued on the next line after a backslash.
+        continuation = trimmed.ends_with('\\');
+        end = i + 1;
+    }
+
+    auto r = std::string{text.substr(0, end)};
+    node.text.erase(0, end);
+    node.line_nr += static_cast<int>(std::count(r.begin(), r.end(), '\n'));
+    if (node.text.empty()) {
+        ir.erase(ir.begin());
+    }
+    return r;
+}
+
+/** Find the text of a static template.
+ *
+ * A template is static when all its text is a single piece, without
+ * placeholders, directives or verbatim C++ in between.
+ *
+ * @return The text node, or `ir.end()` when the template is not static.
+ */
+[[nodiscard]] inline csp_ir::iterator find_csp_static_text(csp_ir& ir) noexcept
+{
+    auto r = ir.end();
+    for (auto it = ir.begin(); it != ir.end(); ++it) {
+        if (it->kind == csp_ir_kind::verbatim or it->kind == csp_ir_kind::default_filters) {
+            continue;
+        } else if (it->kind == csp_ir_kind::text and r == ir.end()) {
+            r = it;
+        } else {
+            return ir.end();
+        }
+    }
+    return r;
+}
+
+/** Translate a placeholder into a C++ expression.
+ *
+ * @param arguments The arguments to std::format().
+ * @param filters The filters to apply to the result, an empty filter is the identity.
+ */
+[[nodiscard]] inline std::string
+translate_csp_placeholder(std::vector<std::string> const& arguments, std::vector<std::string> const& filters)
 {
     using namespace std::literals;
 
-    auto arguments = std::vector<std::string>{};
-    auto filters = std::vector<std::string>{};
+    auto str = std::string{};
+    for (auto& filter : std::views::reverse(filters)) {
+        str += std::format("({})(", filter.empty() ? "[](auto const &x){return x;}"sv : std::string_view{filter});
+    }
+
+    str += "std::format("s;
+    auto is_first_argument = true;
+    for (auto& argument : arguments) {
+        if (not is_first_argument) {
+            str += ", ";
+        }
+        str += std::format("({})", argument);
+        is_first_argument = false;
+    }
+    str += ")"s;
+
+    for (auto& filter : filters) {
+        str += ")"s;
+    }
+    return str;
+}
+
+/** Translate the start of a cached region.
+ *
+ * The cached fragment is looked up, on a miss the output of the region is
+ * appended to a local string which is inserted in the cache at the end of the
+ * region.
+ *
+ * @param node The cache node.
+ * @param path The path of the template, or included template, containing the
+ *             region; to make the key unique for each region.
+ * @param name The name of the variable holding the fragment.
+ * @param config Options for translation.
+ */
+[[nodiscard]] inline std::string translate_csp_cache_begin(
+    csp_ir_node const& node,
+    std::string_view path,
+    std::string_view name,
+    translate_csp_config const& config)
+{
+    // The region is part of the key, so that different regions can use the same key expression.
+    auto const region = encode_string_literal(std::format("{}:{}", path, node.line_nr));
+    return std::format(
+        "{{\n"
+        "auto const {0}_key = std::format(\"{{}}\\x1f{{}}\", \"{1}\", ({2}));\n"
+        "auto {0} = {3}.get({0}_key);\n"
+        "if (not {0}) {{\n"
+        "auto {0}_text = std::string{{}};\n",
+        name,
+        region,
+        node.text,
+        config.fragment_cache_name);
+}
+
+/** Translate the end of a cached region.
+ *
+ * @param name The name of the variable holding the fragment.
+ * @param config Options for translation of the output of the fragment.
+ * @param resume_point A unique number for the point after the output, used by resumable templates.
+ */
+[[nodiscard]] inline std::string
+translate_csp_cache_end(std::string_view name, translate_csp_config const& config, int resume_point)
+{
+    auto r = std::format("{0} = {1}.put({0}_key, std::move({0}_text));\n}}\n", name, config.fragment_cache_name);
+
+    auto const fragment = std::format("*{}", name);
+    if (config.resumable_name) {
+        // The case-label must be outside of the block, so that resuming does not jump past the initialization of its variables.
+        r += std::format(
+            "if (not {0}.append({1})) return {0}.suspend({2});\n}}\n[[fallthrough]];\ncase {2}:;\n", *config.resumable_name, fragment, resume_point);
+    } else {
+        r += translate_csp_yield(fragment, config);
+        r += "}\n";
+    }
+    return r;
+}
+
+/** Count the sections of a parallel region.
+ *
+ * @param first The node after the parallel node.
+ * @param last The end of the IR.
+ * @return The number of sections.
+ */
+[[nodiscard]] inline std::size_t count_csp_sections(csp_ir::const_iterator first, csp_ir::const_iterator last) noexcept
+{
+    auto r = std::size_t{1};
+    auto depth = 0;
+    for (auto it = first; it != last; ++it) {
+        if (it->kind == csp_ir_kind::cache or it->kind == csp_ir_kind::parallel) {
+            ++depth;
+        } else if (it->kind == csp_ir_kind::end) {
+            if (depth-- == 0) {
+                break;
+            }
+        } else if (it->kind == csp_ir_kind::section and depth == 0) {
+            ++r;
+        }
+    }
+    return r;
+}
+
+/** Translate the start of a parallel region.
+ *
+ * Each section is a lambda which appends its output to its own string. The
+ * lambda is passed to the executor by a csp::parallel_sections object.
+ *
+ * @param node The parallel node.
+ * @param name The name of the csp::parallel_sections variable.
+ * @param num_sections The number of sections in the region.
+ */
+[[nodiscard]] inline std::string
+translate_csp_parallel_begin(csp_ir_node const& node, std::string_view name, std::size_t num_sections)
+{
+    return std::format(
+        "{{\n"
+        "auto&& {0}_executor = ({1});\n"
+        "auto {0} = csp::parallel_sections{{{2}}};\n"
+        "{0}.run({0}_executor, 0, [&](std::string& {0}_text) {{\n",
+        name,
+        node.text,
+        num_sections);
+}
+
+/** Translate the start of the next section of a parallel region.
+ *
+ * @param name The name of the csp::parallel_sections variable.
+ * @param index The index of the section.
+ */
+[[nodiscard]] inline std::string translate_csp_section(std::string_view name, std::size_t index)
+{
+    return std::format("}});\n{0}.run({0}_executor, {1}, [&](std::string& {0}_text) {{\n", name, index);
+}
+
+/** Translate the end of a parallel region.
+ *
+ * Waits for the sections and outputs them in order.
+ *
+ * @param name The name of the csp::parallel_sections variable.
+ * @param config Options for translation of the output of the sections.
+ * @param resume_point A unique number for the point after the output, used by resumable templates.
+ */
+[[nodiscard]] inline std::string
+translate_csp_parallel_end(std::string_view name, translate_csp_config const& config, int resume_point)
+{
+    if (config.resumable_name) {
+        // The sections are joined so that they can be appended at a single resume-point.
+        return std::format(
+            "}});\nif (not {0}.append({1}.join())) return {0}.suspend({2});\n}}\n[[fallthrough]];\ncase {2}:;\n",
+            *config.resumable_name,
+            name,
+            resume_point);
+    } else {
+        return std::format(
+            "}});\nfor (auto const& {0}_section : {0}.wait()) {{\n{1}}}\n}}\n",
+            name,
+            translate_csp_yield(std::format("{}_section", name), config));
+    }
+}
+
+/** A region started by a directive, which is closed by `${@end}`.
+ */
+struct translate_csp_block {
+    csp_ir_kind kind;
+
+    /** The name of the variable of the region.
+     */
+    std::string name;
+
+    /** The configuration for the output around the region.
+     */
+    translate_csp_config sink;
+
+    /** The index of the current section of a parallel region.
+     */
+    std::size_t section = 0;
+};
+
+/** Translate the IR of a template into C++ code.
+ *
+ * The IR is consumed; the text of verbatim nodes is moved into the generated code.
+ */
+[[nodiscard]] inline generator<std::string> translate_csp_nodes(
+    csp_ir& ir,
+    std::filesystem::path const& path,
+    translate_csp_config const& config,
+    csp_text_pool *text_pool) noexcept
+{
     auto default_filters = std::vector<std::string>{};
+    auto resume_point = 0;
+
+    // Inside a cached region or a section the output is appended to a local
+    // string; the configurations of the enclosing regions are kept on a stack.
+    auto sink = config;
+    auto blocks = std::vector<translate_csp_block>{};
+    auto block_count = 0;
+
+    // The path of the current template, for instrumentation and the keys of cached regions.
+    auto current_path = path.generic_string();
+    auto const instrument = [&](std::string str, int line_nr, std::string_view kind) {
+        return config.instrument ? translate_csp_instrument(str, current_path, line_nr, kind) : str;
+    };
+
+    auto const count = [&](std::size_t num_outputs, std::size_t num_format_calls) {
+        if (config.statistics) {
+            config.statistics->num_outputs += num_outputs;
+            config.statistics->num_format_calls += num_format_calls;
+        }
+    };
 
     if (auto x = translate_csp_path(path, config)) {
-        co_yield *x;
+        co_yield std::move(*x);
     }
 
-    for (auto it = first; it != last; ++it) {
-        auto const& token = *it;
-        if (token.kind == csp_token_type::verbatim) {
-            if (not token.text.empty()) {
-                if (auto x = translate_csp_line(token, config)) {
-                    co_yield *x;
-                }
+    for (auto it = ir.begin(); it != ir.end(); ++it) {
+        auto const& node = *it;
+        if (node.kind == csp_ir_kind::verbatim) {
+            if (auto x = translate_csp_line(node, config)) {
+                co_yield std::move(*x);
+            }
 
-                co_yield token.text;
-                if (token.text.back() != '\n') {
-                    co_yield "\n";
-                }
+            auto text = std::move(it->text);
+            if (text.back() != '\n') {
+                text += '\n';
             }
+            co_yield std::move(text);
 
-        } else if (token.kind == csp_token_type::text) {
-            if (not token.text.empty()) {
-                if (auto x = translate_csp_line(token, config)) {
-                    co_yield *x;
-                }
+        } else if (node.kind == csp_ir_kind::text) {
+            if (auto x = translate_csp_line(node, config)) {
+                co_yield std::move(*x);
+            }
 
-                auto const num_lines = std::count(token.text.begin(), token.text.end(), '\n');
-                if (num_lines == 0 or (num_lines == 1 and token.text.back() == '\n')) {
-                    // Only one line.
-                    co_yield translate_csp_yield(std::format("\"{}\"", encode_string_literal(token.text)), config);
+            auto str = text_pool ? text_pool->reference(node.text) : translate_csp_text(node.text);
+            count(1, 0);
+            co_yield translate_csp_yield(instrument(std::move(str), node.line_nr, "text"), sink, ++resume_point);
 
-                } else {
-                    auto str = std::string{};
+        } else if (node.kind == csp_ir_kind::path) {
+            current_path = node.text;
+            if (auto x = translate_csp_file(node, config)) {
+                co_yield std::move(*x);
+            }
 
-                    auto prev_i = size_t{};
-                    auto i = token.text.find('\n');
-                    while (i != token.text.npos) {
-                        ++i;
+        } else if (node.kind == csp_ir_kind::escape) {
+            if (auto x = translate_csp_line(node, config)) {
+                co_yield std::move(*x);
+            }
 
-                        if (prev_i != 0) {
-                            str += "\n  ";
-                        }
-                        str += std::format("\"{}\"", encode_string_literal(token.text.substr(prev_i, i - prev_i)));
+            count(1, 0);
+            co_yield translate_csp_yield(instrument(node.text, node.line_nr, "escape"), sink, ++resume_point);
 
-                        i = token.text.find('\n', prev_i = i);
-                    }
+        } else if (node.kind == csp_ir_kind::default_filters) {
+            default_filters = node.filters;
 
-                    if (prev_i != token.text.size()) {
-                        str += std::format("\n  \"{}\"", encode_string_literal(token.text.substr(prev_i)));
-                    }
-                    co_yield translate_csp_yield(str, config);
-                }
+        } else if (node.kind == csp_ir_kind::placeholder) {
+            if (auto x = translate_csp_line(node, config)) {
+                co_yield std::move(*x);
             }
 
-        } else if (token.kind == csp_token_type::placeholder_argument) {
-            arguments.emplace_back(token.text);
+            auto const& filters = node.filters.empty() ? default_filters : node.filters;
+            count(1, 1);
+            co_yield translate_csp_yield(
+                instrument(translate_csp_placeholder(node.arguments, filters), node.line_nr, "placeholder"), sink, ++resume_point);
 
-        } else if (token.kind == csp_token_type::placeholder_filter) {
-            if (token.empty()) {
-                filters.emplace_back("[](auto const &x){return x;}");
-            } else {
-                filters.emplace_back(token.text);
+        } else if (node.kind == csp_ir_kind::cache) {
+            if (auto x = translate_csp_line(node, config)) {
+                co_yield std::move(*x);
             }
 
-        } else if (token.kind == csp_token_type::placeholder_end) {
-            if (arguments.empty()) {
-                if (filters.empty()) {
-                    // empty placeholder.
-                } else {
-                    // update default filters.
-                    default_filters.clear();
-                    for (auto& filter : filters) {
-                        default_filters.push_back(filter);
-                    }
-                }
+            auto name = std::format("csp_fragment_{}", ++block_count);
+            // The key of the fragment is formatted.
+            count(0, 1);
+            co_yield translate_csp_cache_begin(node, current_path, name, config);
 
-            } else if (
-                filters.empty() and arguments.size() == 1 and arguments.front().front() == '"' and
-                arguments.front().back() == '"') {
-                // Escape.
-                if (auto x = translate_csp_line(token, config)) {
-                    co_yield *x;
-                }
+            blocks.emplace_back(node.kind, name, sink);
+            sink.callback_name = std::nullopt;
+            sink.resumable_name = std::nullopt;
+            sink.append_name = name + "_text";
+
+        } else if (node.kind == csp_ir_kind::parallel) {
+            if (auto x = translate_csp_line(node, config)) {
+                co_yield std::move(*x);
+            }
+
+            auto name = std::format("csp_parallel_{}", ++block_count);
+            co_yield translate_csp_parallel_begin(node, name, count_csp_sections(std::next(it), ir.end()));
 
-                co_yield translate_csp_yield(arguments.front(), config);
+            blocks.emplace_back(node.kind, name, sink);
+            sink.callback_name = std::nullopt;
+            sink.resumable_name = std::nullopt;
+            sink.append_name = name + "_text";
 
+        } else if (node.kind == csp_ir_kind::section) {
+            if (blocks.empty() or blocks.back().kind != csp_ir_kind::parallel) {
+                throw csp_error(std::format("{}:{}: Found @section outside of @parallel.", current_path, node.line_nr));
+            }
+
+            co_yield translate_csp_section(blocks.back().name, ++blocks.back().section);
+
+        } else if (node.kind == csp_ir_kind::end) {
+            if (blocks.empty()) {
+                throw csp_error(std::format("{}:{}: Found @end without a matching directive.", current_path, node.line_nr));
+            }
+
+            auto const block = std::move(blocks.back());
+            blocks.pop_back();
+            sink = block.sink;
+            count(1, 0);
+            if (block.kind == csp_ir_kind::cache) {
+                co_yield translate_csp_cache_end(block.name, sink, ++resume_point);
             } else {
-                if (filters.empty()) {
-                    filters = default_filters;
-                }
+                co_yield translate_csp_parallel_end(block.name, sink, ++resume_point);
+            }
 
-                if (arguments.size() == 1) {
-                    arguments.emplace(arguments.begin(), "\"{}\"");
-                }
+        } else if (node.kind == csp_ir_kind::flush) {
+            // The output of a cached region or section is kept until the end of the region.
+            if (not blocks.empty()) {
+                continue;
+            }
 
-                if (auto x = translate_csp_line(token, config)) {
-                    co_yield *x;
+            if (auto x = translate_csp_flush(config, ++resume_point)) {
+                if (auto y = translate_csp_line(node, config)) {
+                    co_yield std::move(*y);
                 }
+                co_yield std::move(*x);
+            }
 
-                auto str = std::string{};
-                for (auto& filter : std::views::reverse(filters)) {
-                    str += std::format("({})(", filter);
-                }
+        } else {
+            throw csp_error(std::format("{}:{}: Unknown IR node.", current_path, node.line_nr));
+        }
+    }
+
+    if (not blocks.empty()) {
+        throw csp_error(std::format("{}: Missing @end for a {} region.", current_path, blocks.back().kind == csp_ir_kind::cache ? "@cache" : "@parallel"));
+    }
+}
+
+/** Pool the text of one or more templates.
+ *
+ * @param name The name of the character array in the generated code.
+ * @param irs The IR of the templates.
+ */
+[[nodiscard]] inline csp_text_pool make_csp_text_pool(std::string name, std::vector<csp_ir const *> const& irs) noexcept
+{
+    auto texts = std::vector<std::string_view>{};
+    for (auto const ir : irs) {
+        for (auto const& node : *ir) {
+            if (node.kind == csp_ir_kind::text) {
+                texts.push_back(node.text);
+            }
+        }
+    }
+
+    // By adding the longest text first, shorter text is more likely to be
+    // found inside the text already in the pool.
+    std::stable_sort(texts.begin(), texts.end(), [](auto const& a, auto const& b) {
+        return a.size() > b.size();
+    });
+
+    auto r = csp_text_pool{std::move(name)};
+    for (auto const& text : texts) {
+        r.insert(text);
+    }
+    return r;
+}
+
+} // namespace detail
+
+/** A template that is part of a unity file, see `translate_csp_unity()`.
+ */
+struct csp_unity_template {
+    /** The IR of the template, after the passes were run.
+     */
+    csp_ir ir;
+
+    /** The path of the template, used for the #line directives.
+     */
+    std::filesystem::path path;
+};
+
+namespace detail {
+
+/** Translate the IR of one or more templates into the C++ code of a single file.
+ *
+ * @param templates The templates, in the order of the generated code.
+ * @param config Options for translation, `static_name` must not be set.
+ */
+[[nodiscard]] inline generator<std::string>
+translate_csp_templates(std::vector<csp_unity_template> templates, translate_csp_config config) noexcept
+{
+    if (config.module_name) {
+        // A module-file must start with the global module fragment, which
+        // holds the preamble of each template.
+        co_yield "module;\n";
+        for (auto& t : templates) {
+            if (auto x = translate_csp_path(t.path, config)) {
+                co_yield std::move(*x);
+            }
+            co_yield split_csp_preamble(t.ir);
+        }
+
+        co_yield translate_csp_module(*config.module_name);
+    }
+
+    // The text-pool must be complete before it is declared in front of the
+    // generated code.
+    auto text_pool = std::optional<csp_text_pool>{};
+    if (config.text_pool_name) {
+        auto irs = std::vector<csp_ir const *>{};
+        for (auto const& t : templates) {
+            irs.push_back(&t.ir);
+        }
 
-                str += "std::format("s;
-                auto is_first_argument = true;
-                for (auto& argument : arguments) {
-                    if (not is_first_argument) {
-                        str += ", ";
+        text_pool = make_csp_text_pool(*config.text_pool_name, irs);
+        if (not text_pool->empty()) {
+            // Declare the text-pool after the preamble, so that it is inside
+            // the include guard of a header template.
+            if (not config.module_name and not templates.empty()) {
+                auto& t = templates.front();
+                if (auto preamble = split_csp_preamble(t.ir); not preamble.empty()) {
+                    if (auto x = translate_csp_path(t.path, config)) {
+                        co_yield std::move(*x);
                     }
-                    str += std::format("({})", argument);
-                    is_first_argument = false;
+                    co_yield std::move(preamble);
                 }
-                str += ")"s;
+            }
 
-                for (auto& filter : filters) {
-                    str += ")"s;
-                }
+            co_yield text_pool->declaration();
+        }
+    }
 
-                co_yield translate_csp_yield(str, config);
-            }
+    if (config.module_name) {
+        co_yield "export {\n";
+    }
 
-            arguments.clear();
-            filters.clear();
+    for (auto& t : templates) {
+        co_yield elements_of(translate_csp_nodes(t.ir, t.path, config, text_pool ? &*text_pool : nullptr));
+    }
 
-        } else {
-            std::terminate();
+    if (config.module_name) {
+        co_yield "}\n";
+    }
+}
+
+} // namespace detail
+
+/** Translate IR into C++ code.
+ *
+ * The passes are not run, this allows tools to translate IR they optimized themselves.
+ *
+ * With a module name the generated code is a module interface unit. The
+ * preamble of the template, the `#include` directives at its start, is placed
+ * in the global module fragment and the rest of the template is exported.
+ *
+ * @param ir The IR of the template.
+ * @param path The path of the template, used for the #line directives.
+ * @param config Options for translation.
+ * @return A generator yielding pieces of C++ code.
+ */
+[[nodiscard]] inline generator<std::string> translate_csp_ir(csp_ir ir, std::filesystem::path path, translate_csp_config config) noexcept
+{
+    if (config.static_name) {
+        if (config.module_name) {
+            throw csp_error(std::format("{}: A static template can not be a module.", path.string()));
+        }
+
+        auto preamble = detail::split_csp_preamble(ir);
+        auto const text = detail::find_csp_static_text(ir);
+        if (text == ir.end()) {
+            throw csp_error(std::format(
+                "{}: The template is not static, it has placeholders, directives or C++ code between its text.", path.string()));
         }
+
+        if (not preamble.empty()) {
+            if (auto x = translate_csp_path(path, config)) {
+                co_yield std::move(*x);
+            }
+            co_yield std::move(preamble);
+        }
+        co_yield translate_csp_static(*config.static_name, text->text);
+
+        // Output the constant instead of the text.
+        *text = csp_ir_node{csp_ir_kind::escape, text->line_nr, *config.static_name};
+        co_yield elements_of(detail::translate_csp_nodes(ir, path, config, nullptr));
+        co_return;
     }
+
+    auto templates = std::vector<csp_unity_template>{};
+    templates.emplace_back(std::move(ir), std::move(path));
+    co_yield elements_of(detail::translate_csp_templates(std::move(templates), std::move(config)));
 }
+
+/** Translate multiple templates into the C++ code of a single file.
+ *
+ * The code of each template follows the code of the previous template, each
+ * with its own #line directives. With a text-pool the text of all templates
+ * is pooled in a single character array in front of the generated code. With
+ * a module name the preambles of all templates are placed in the global
+ * module fragment.
+ *
+ * @param templates The templates, in the order of the generated code.
+ * @param config Options for translation, `static_name` must not be set.
+ * @return A generator yielding pieces of C++ code.
+ */
+[[nodiscard]] inline generator<std::string>
+translate_csp_unity(std::vector<csp_unity_template> templates, translate_csp_config config) noexcept
+{
+    if (config.static_name) {
+        throw csp_error("A unity file can not contain static templates.");
+    }
+
+    co_yield elements_of(detail::translate_csp_templates(std::move(templates), std::move(config)));
+}
+
+/** Translate a template into C++ code.
+ *
+ * The tokens are lowered into IR, then optimized by the passes which are not
+ * disabled in the configuration.
+ *
+ * @param first An iterator to the first token.
+ * @param last A sentinel beyond the last token.
+ * @param path The path of the template, used for the #line directives.
+ * @param config Options for translation.
+ * @return A generator yielding pieces of C++ code.
+ */
+template<std::input_iterator It, std::sentinel_for<It> ItEnd>
+[[nodiscard]] generator<std::string>
+translate_csp(It first, ItEnd last, std::filesystem::path path, translate_csp_config config) noexcept
+{
+    auto ir = lower_csp(first, last);
+    run_csp_passes(ir, config.disabled_passes, config.enabled_passes);
+    co_yield elements_of(translate_csp_ir(std::move(ir), std::move(path), std::move(config)));
+}
+
 }} // namespace csp::v1
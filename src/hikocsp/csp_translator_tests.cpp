@@ -0,0 +1,496 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "csp_translator.hpp"
+#include "csp_parser.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+namespace csp_translator_tests {
+
+[[nodiscard]] std::string translate(std::string_view str, csp::translate_csp_config const& config)
+{
+    auto tokens = csp::parse_csp(str, "<none>");
+
+    auto r = std::string{};
+    for (auto const& s : csp::translate_csp(tokens.begin(), tokens.end(), "<none>", config)) {
+        r += s;
+    }
+    return r;
+}
+
+[[nodiscard]] csp::csp_ir lower(std::string_view str)
+{
+    auto tokens = csp::parse_csp(str, "<none>");
+    auto r = csp::lower_csp(tokens.begin(), tokens.end());
+    csp::run_csp_passes(r, {}, {});
+    return r;
+}
+
+} // namespace csp_translator_tests
+
+TEST(csp_translator, text_pool_insert)
+{
+    auto pool = csp::csp_text_pool{"pool"};
+
+    ASSERT_TRUE(pool.empty());
+    ASSERT_EQ(pool.insert("<tr><td>"), 0);
+    ASSERT_EQ(pool.insert("</td></tr>"), 8);
+    ASSERT_EQ(pool.size(), 18);
+
+    // Duplicate and sub-strings are not added again.
+    ASSERT_EQ(pool.insert("<tr><td>"), 0);
+    ASSERT_EQ(pool.insert("td>"), 5);
+    ASSERT_EQ(pool.insert("</td></tr>"), 8);
+    ASSERT_EQ(pool.size(), 18);
+}
+
+TEST(csp_translator, text_pool_declaration)
+{
+    auto pool = csp::csp_text_pool{"pool"};
+    pool.insert("foo\nbar\n");
+    pool.insert("\"baz\"");
+
+    ASSERT_EQ(
+        pool.declaration(),
+        "static constexpr char pool[] =\n"
+        "  \"foo\\n\"\n"
+        "  \"bar\\n\"\n"
+        "  \"\\\"baz\\\"\";\n");
+    ASSERT_EQ(pool.reference("bar"), "std::string_view{pool + 4, 3}");
+}
+
+TEST(csp_translator, text_pool)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.text_pool_name = "pool";
+
+    auto const result = csp_translator_tests::translate("{{<td>${a}</td><td>${b}</td>}}", config);
+
+    ASSERT_EQ(
+        result,
+        "static constexpr char pool[] =\n"
+        "  \"</td><td>\";\n"
+        "co_yield std::string_view{pool + 5, 4};\n"
+        "co_yield std::format((\"{}\"), (a));\n"
+        "co_yield std::string_view{pool + 0, 9};\n"
+        "co_yield std::format((\"{}\"), (b));\n"
+        "co_yield std::string_view{pool + 0, 5};\n");
+
+    ASSERT_EQ(
+        csp_translator_tests::translate("#ifndef PAGE_HPP\n#define PAGE_HPP\n\nvoid f() {{{<td>${a}</td>}}}\n#endif\n", config),
+        "#ifndef PAGE_HPP\n"
+        "#define PAGE_HPP\n"
+        "\n"
+        "static constexpr char pool[] =\n"
+        "  \"</td><td>\";\n"
+        "void f() {\n"
+        "co_yield std::string_view{pool + 5, 4};\n"
+        "co_yield std::format((\"{}\"), (a));\n"
+        "co_yield std::string_view{pool + 0, 5};\n"
+        "}\n"
+        "#endif\n");
+}
+
+TEST(csp_translator, unity)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = true;
+    config.text_pool_name = "pool";
+
+    auto templates = std::vector<csp::csp_unity_template>{};
+    templates.emplace_back(csp_translator_tests::lower("{{<td>${a}</td>}}"), "a.csp");
+    templates.emplace_back(csp_translator_tests::lower("{{<td>${b}</td>}}"), "b.csp");
+
+    auto result = std::string{};
+    for (auto const& s : csp::translate_csp_unity(templates, config)) {
+        result += s;
+    }
+
+    ASSERT_EQ(
+        result,
+        "static constexpr char pool[] =\n"
+        "  \"</td><td>\";\n"
+        "#line 1 \"a.csp\"\n"
+        "#line 1\n"
+        "co_yield std::string_view{pool + 5, 4};\n"
+        "#line 1\n"
+        "co_yield std::format((\"{}\"), (a));\n"
+        "#line 1\n"
+        "co_yield std::string_view{pool + 0, 5};\n"
+        "#line 1 \"b.csp\"\n"
+        "#line 1\n"
+        "co_yield std::string_view{pool + 5, 4};\n"
+        "#line 1\n"
+        "co_yield std::format((\"{}\"), (b));\n"
+        "#line 1\n"
+        "co_yield std::string_view{pool + 0, 5};\n");
+
+    config.static_name = "page";
+    ASSERT_THROW(
+        [&] {
+            for (auto const& s : csp::translate_csp_unity(templates, config)) {
+                result += s;
+            }
+        }(),
+        csp::csp_error);
+}
+
+TEST(csp_translator, module)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = true;
+    config.module_name = "pages";
+
+    ASSERT_EQ(
+        csp_translator_tests::translate("// Pages.\n#include <format>\n\nvoid f() {{{<p>${a}</p>}}}\n", config),
+        "module;\n"
+        "#line 1 \"<none>\"\n"
+        "// Pages.\n"
+        "#include <format>\n"
+        "\n"
+        "export module pages;\n"
+        "export import hikocsp;\n"
+        "export {\n"
+        "#line 1 \"<none>\"\n"
+        "#line 4\n"
+        "void f() {\n"
+        "#line 4\n"
+        "co_yield \"<p>\";\n"
+        "#line 4\n"
+        "co_yield std::format((\"{}\"), (a));\n"
+        "#line 4\n"
+        "co_yield \"</p>\";\n"
+        "#line 4\n"
+        "}\n"
+        "}\n");
+
+    config.static_name = "page";
+    ASSERT_THROW(std::ignore = csp_translator_tests::translate("{{<p></p>}}", config), csp::csp_error);
+}
+
+TEST(csp_translator, unbalanced_ir)
+{
+    auto const translate = [](csp::csp_ir ir) {
+        auto config = csp::translate_csp_config{};
+        config.enable_line = false;
+
+        auto r = std::string{};
+        for (auto const& s : csp::translate_csp_ir(std::move(ir), "<none>", config)) {
+            r += s;
+        }
+        return r;
+    };
+
+    ASSERT_THROW(std::ignore = translate({{csp::csp_ir_kind::section, 1}}), csp::csp_error);
+    ASSERT_THROW(std::ignore = translate({{csp::csp_ir_kind::end, 1}}), csp::csp_error);
+    ASSERT_THROW(std::ignore = translate({{csp::csp_ir_kind::cache, 1, "id"}}), csp::csp_error);
+}
+
+TEST(csp_translator, resumable)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.resumable_name = "out";
+
+    auto const result = csp_translator_tests::translate("{{<td>${a}</td>}}", config);
+
+    ASSERT_EQ(
+        result,
+        "if (not out.append(\"<td>\")) return out.suspend(1);\n"
+        "[[fallthrough]];\n"
+        "case 1:;\n"
+        "if (not out.append(std::format((\"{}\"), (a)))) return out.suspend(2);\n"
+        "[[fallthrough]];\n"
+        "case 2:;\n"
+        "if (not out.append(\"</td>\")) return out.suspend(3);\n"
+        "[[fallthrough]];\n"
+        "case 3:;\n");
+}
+
+TEST(csp_translator, cache)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+
+    auto const result = csp_translator_tests::translate("{{<ul>${@cache id}<li>${a}</li>${@end}</ul>}}", config);
+
+    ASSERT_EQ(
+        result,
+        "co_yield \"<ul>\";\n"
+        "{\n"
+        "auto const csp_fragment_1_key = std::format(\"{}\\x1f{}\", \"<none>:1\", (id));\n"
+        "auto csp_fragment_1 = fragment_cache.get(csp_fragment_1_key);\n"
+        "if (not csp_fragment_1) {\n"
+        "auto csp_fragment_1_text = std::string{};\n"
+        "csp_fragment_1_text += \"<li>\";\n"
+        "csp_fragment_1_text += std::format((\"{}\"), (a));\n"
+        "csp_fragment_1_text += \"</li>\";\n"
+        "csp_fragment_1 = fragment_cache.put(csp_fragment_1_key, std::move(csp_fragment_1_text));\n"
+        "}\n"
+        "co_yield *csp_fragment_1;\n"
+        "}\n"
+        "co_yield \"</ul>\";\n");
+}
+
+TEST(csp_translator, cache_include)
+{
+    auto const dir = std::filesystem::temp_directory_path() / "hikocsp_csp_translator_tests";
+    std::filesystem::create_directories(dir);
+    {
+        auto f = std::ofstream(dir / "inc.csp");
+        f << "\n${@cache k}B${@end}";
+    }
+
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+
+    // Both regions are on line 2, of different templates.
+    auto const main_path = dir / "main.csp";
+    auto const text = std::string{"{{\n${@cache k}A${@end}${@include \"inc.csp\"}}}"};
+    auto const tokens = csp::parse_csp(text, main_path);
+    auto result = std::string{};
+    for (auto const& s : csp::translate_csp(tokens.begin(), tokens.end(), main_path, config)) {
+        result += s;
+    }
+
+    auto const main_key = std::format("\"{}:2\"", main_path.generic_string());
+    auto const inc_key = std::format("\"{}:2\"", (dir / "inc.csp").generic_string());
+    ASSERT_NE(result.find(main_key), result.npos);
+    ASSERT_NE(result.find(inc_key), result.npos);
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(csp_translator, cache_resumable)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.resumable_name = "out";
+    config.fragment_cache_name = "cache";
+
+    auto const result = csp_translator_tests::translate("{{${@cache id}${a}${@end}}}", config);
+
+    ASSERT_EQ(
+        result,
+        "{\n"
+        "auto const csp_fragment_1_key = std::format(\"{}\\x1f{}\", \"<none>:1\", (id));\n"
+        "auto csp_fragment_1 = cache.get(csp_fragment_1_key);\n"
+        "if (not csp_fragment_1) {\n"
+        "auto csp_fragment_1_text = std::string{};\n"
+        "csp_fragment_1_text += std::format((\"{}\"), (a));\n"
+        "csp_fragment_1 = cache.put(csp_fragment_1_key, std::move(csp_fragment_1_text));\n"
+        "}\n"
+        "if (not out.append(*csp_fragment_1)) return out.suspend(2);\n"
+        "}\n"
+        "[[fallthrough]];\n"
+        "case 2:;\n");
+}
+
+TEST(csp_translator, flush)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+
+    // Without a flush function the output is already sent at once.
+    ASSERT_EQ(csp_translator_tests::translate("{{a${@flush}b}}", config), "co_yield \"a\";\nco_yield \"b\";\n");
+
+    config.flush_name = "flush";
+    ASSERT_EQ(csp_translator_tests::translate("{{a${@flush}b}}", config), "co_yield \"a\";\nflush();\nco_yield \"b\";\n");
+
+    config.append_name = "out";
+    ASSERT_EQ(
+        csp_translator_tests::translate("{{a${@flush}b}}", config), "out += \"a\";\nflush(out);\nout.clear();\nout += \"b\";\n");
+
+    // The output of a cached region is not flushed.
+    ASSERT_EQ(csp_translator_tests::translate("{{${@cache id}${@flush}${@end}}}", config).find("flush"), std::string::npos);
+}
+
+TEST(csp_translator, flush_resumable)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.resumable_name = "out";
+
+    ASSERT_EQ(
+        csp_translator_tests::translate("{{a${@flush}b}}", config),
+        "if (not out.append(\"a\")) return out.suspend(1);\n"
+        "[[fallthrough]];\n"
+        "case 1:;\n"
+        "if (out.size() != 0) return out.suspend(2);\n"
+        "[[fallthrough]];\n"
+        "case 2:;\n"
+        "if (not out.append(\"b\")) return out.suspend(3);\n"
+        "[[fallthrough]];\n"
+        "case 3:;\n");
+}
+
+TEST(csp_translator, parallel)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+
+    auto const result = csp_translator_tests::translate("{{<p>${@parallel pool}${a}${@section}b${@end}</p>}}", config);
+
+    ASSERT_EQ(
+        result,
+        "co_yield \"<p>\";\n"
+        "{\n"
+        "auto&& csp_parallel_1_executor = (pool);\n"
+        "auto csp_parallel_1 = csp::parallel_sections{2};\n"
+        "csp_parallel_1.run(csp_parallel_1_executor, 0, [&](std::string& csp_parallel_1_text) {\n"
+        "csp_parallel_1_text += std::format((\"{}\"), (a));\n"
+        "});\n"
+        "csp_parallel_1.run(csp_parallel_1_executor, 1, [&](std::string& csp_parallel_1_text) {\n"
+        "csp_parallel_1_text += \"b\";\n"
+        "});\n"
+        "for (auto const& csp_parallel_1_section : csp_parallel_1.wait()) {\n"
+        "co_yield csp_parallel_1_section;\n"
+        "}\n"
+        "}\n"
+        "co_yield \"</p>\";\n");
+}
+
+TEST(csp_translator, parallel_resumable)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.resumable_name = "out";
+
+    auto const result = csp_translator_tests::translate("{{${@parallel pool}a${@section}${@cache id}b${@end}${@end}}}", config);
+
+    ASSERT_TRUE(result.starts_with("{\nauto&& csp_parallel_1_executor = (pool);\nauto csp_parallel_1 = csp::parallel_sections{2};\n"));
+    ASSERT_NE(result.find("csp_fragment_2_text += \"b\";\n"), std::string::npos);
+    ASSERT_NE(result.find("csp_parallel_1_text += *csp_fragment_2;\n}\n"), std::string::npos);
+    ASSERT_TRUE(result.ends_with(
+        "});\n"
+        "if (not out.append(csp_parallel_1.join())) return out.suspend(4);\n"
+        "}\n"
+        "[[fallthrough]];\n"
+        "case 4:;\n"));
+}
+
+TEST(csp_translator, instrument)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.instrument = true;
+
+    auto const result = csp_translator_tests::translate("{{<td>\n${a}}}", config);
+
+    ASSERT_EQ(
+        result,
+        "co_yield ([&] { static auto csp_site = csp::profile_site{\"<none>\", 1, \"text\"}; return csp_site.count(\"<td>\\n\"); })();\n"
+        "co_yield ([&] { static auto csp_site = csp::profile_site{\"<none>\", 2, \"placeholder\"}; "
+        "return csp_site.measure([&] { return std::format((\"{}\"), (a)); }); })();\n");
+}
+
+TEST(csp_translator, statistics)
+{
+    auto statistics = csp::translate_csp_statistics{};
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.statistics = &statistics;
+
+    [[maybe_unused]] auto const result = csp_translator_tests::translate("{{<td>${a}</td>${@cache k}${b}${@end}}}", config);
+
+    // The text, two placeholders and the output of the cached fragment.
+    ASSERT_EQ(statistics.num_outputs, 5);
+    // The two placeholders and the key of the fragment.
+    ASSERT_EQ(statistics.num_format_calls, 3);
+}
+
+TEST(csp_translator, static_template)
+{
+    auto config = csp::translate_csp_config{};
+    config.enable_line = false;
+    config.static_name = "page";
+
+    ASSERT_EQ(
+        csp_translator_tests::translate("void f() {{{<p>\n$$5</p>\n}}}", config),
+        "#include <string_view>\n"
+        "static constexpr auto page = std::string_view{\n"
+        "  \"<p>\\n\"\n"
+        "  \"\\x24\"\"5</p>\\n\", 11};\n"
+        "void f() {\n"
+        "co_yield page;\n"
+        "}\n");
+
+    config.callback_name = "sink";
+    ASSERT_EQ(
+        csp_translator_tests::translate("{{<p>${\"&amp;\"}</p>}}", config),
+        "#include <string_view>\n"
+        "static constexpr auto page = std::string_view{\n"
+        "  \"<p>&amp;</p>\", 12};\n"
+        "sink(page);\n");
+
+    config.callback_name = std::nullopt;
+    ASSERT_EQ(
+        csp_translator_tests::translate("#ifndef PAGE_HPP\n#define PAGE_HPP\n\nvoid f() {{{<p></p>}}}\n#endif\n", config),
+        "#ifndef PAGE_HPP\n"
+        "#define PAGE_HPP\n"
+        "\n"
+        "#include <string_view>\n"
+        "static constexpr auto page = std::string_view{\n"
+        "  \"<p></p>\", 7};\n"
+        "void f() {\n"
+        "co_yield page;\n"
+        "}\n"
+        "#endif\n");
+
+    ASSERT_THROW(std::ignore = csp_translator_tests::translate("{{<p>${a}</p>}}", config), csp::csp_error);
+    ASSERT_THROW(std::ignore = csp_translator_tests::translate("{{a\n$if (x) {\nb\n$}\n}}", config), csp::csp_error);
+}
+
+TEST(csp_translator, encode_string_literal)
+{
+    ASSERT_EQ(csp::encode_string_literal("foo"), "foo");
+    ASSERT_EQ(csp::encode_string_literal("\"foo\\bar\"\n"), "\\\"foo\\\\bar\\\"\\n");
+    ASSERT_EQ(csp::encode_string_literal("$x"), "\\x24x");
+    ASSERT_EQ(csp::encode_string_literal("$a"), "\\x24\"\"a");
+    ASSERT_EQ(csp::encode_string_literal("0123456789abcdef$0123456789abcdef@"), "0123456789abcdef\\x24\"\"0123456789abcdef\\x40");
+}
+
+TEST(csp_translator, encode_string_literal_all_characters)
+{
+    // Each character in every position of a SIMD block, followed by a hex-digit.
+    for (auto c = 0; c != 256; ++c) {
+        for (auto i = 0; i != 40; ++i) {
+            auto str = std::string(i, 'x');
+            str += static_cast<char>(c);
+            str += "a";
+            str += std::string(40 - i, 'y');
+
+            ASSERT_EQ(csp::encode_string_literal(str), csp::detail::encode_string_literal_reference(str)) << c << " " << i;
+        }
+    }
+}
+
+TEST(csp_translator, encode_string_literal_random)
+{
+    auto engine = std::mt19937{42};
+    auto length_dist = std::uniform_int_distribution<std::size_t>{0, 200};
+    auto char_dist = std::uniform_int_distribution<int>{0, 255};
+    auto plain_dist = std::uniform_int_distribution<int>{0, 7};
+
+    for (auto n = 0; n != 10000; ++n) {
+        auto str = std::string{};
+        auto const length = length_dist(engine);
+        for (auto i = std::size_t{0}; i != length; ++i) {
+            // Mostly plain text, with some characters that need escaping.
+            if (plain_dist(engine) != 0) {
+                str += static_cast<char>('a' + char_dist(engine) % 26);
+            } else {
+                str += static_cast<char>(char_dist(engine));
+            }
+        }
+
+        ASSERT_EQ(csp::encode_string_literal(str), csp::detail::encode_string_literal_reference(str));
+    }
+}
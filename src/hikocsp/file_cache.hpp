@@ -0,0 +1,272 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <concepts>
+#include <format>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+/** Calculate a 64-bit FNV-1a hash.
+ *
+ * @param str The data to hash.
+ * @param hash The hash of the data preceding @a str, to hash data in parts.
+ * @return The hash.
+ */
+[[nodiscard]] constexpr uint64_t fnv1a_hash(std::string_view str, uint64_t hash = 0xcbf2'9ce4'8422'2325) noexcept
+{
+    for (auto c : str) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100'0000'01b3;
+    }
+    return hash;
+}
+
+struct file_cache_statistics {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+
+    /** The fraction of lookups that were found in the cache.
+     */
+    [[nodiscard]] double hit_rate() const noexcept
+    {
+        auto const lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+    }
+
+    file_cache_statistics& operator+=(file_cache_statistics const& rhs) noexcept
+    {
+        hits += rhs.hits;
+        misses += rhs.misses;
+        evictions += rhs.evictions;
+        return *this;
+    }
+};
+
+/** A content-addressed cache of strings stored in a directory.
+ *
+ * Each entry is a file named after its key. The modification time of an entry
+ * is updated when it is found, so that the least-recently used entries are
+ * removed first when the total size exceeds the limit.
+ *
+ * Several processes may use the same directory at the same time; entries are
+ * written to a temporary file first and then renamed.
+ */
+class file_cache {
+public:
+    /** Open a cache.
+     *
+     * @param directory The directory holding the entries, created when it does not exist.
+     * @param max_size The maximum total size of the entries in bytes.
+     */
+    file_cache(std::filesystem::path directory, std::uintmax_t max_size) :
+        _directory(std::move(directory)), _max_size(max_size)
+    {
+        std::filesystem::create_directories(_directory);
+    }
+
+    /** Find an entry.
+     *
+     * @param key The key of the entry.
+     * @param is_valid A function called with the value of the entry, when it
+     *                 returns false the entry is handled as if it was not found.
+     * @return The value of the entry, or std::nullopt if the entry is not in the cache.
+     */
+    template<std::predicate<std::string const&> Validator>
+    [[nodiscard]] std::optional<std::string> get(uint64_t key, Validator const& is_valid)
+    {
+        auto const path = entry_path(key);
+        auto f = std::ifstream(path, std::ios::binary);
+        if (not f.is_open()) {
+            ++_statistics.misses;
+            return std::nullopt;
+        }
+
+        auto r = std::string{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+        f.close();
+
+        if (not is_valid(r)) {
+            ++_statistics.misses;
+            return std::nullopt;
+        }
+
+        // Mark the entry as recently used; it may have been evicted by another process in the mean time.
+        auto ec = std::error_code{};
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+        ++_statistics.hits;
+        return r;
+    }
+
+    /** Find an entry.
+     *
+     * @param key The key of the entry.
+     * @return The value of the entry, or std::nullopt if the entry is not in the cache.
+     */
+    [[nodiscard]] std::optional<std::string> get(uint64_t key)
+    {
+        return get(key, [](std::string const&) {
+            return true;
+        });
+    }
+
+    /** Add or replace an entry.
+     *
+     * Afterwards the least-recently used entries are removed when the total
+     * size of the cache exceeds the limit.
+     *
+     * @param key The key of the entry.
+     * @param value The value of the entry.
+     */
+    void put(uint64_t key, std::string_view value)
+    {
+        auto const path = entry_path(key);
+        auto tmp_path = path;
+        tmp_path += std::format(".{:08x}.tmp", std::random_device{}());
+
+        auto f = std::ofstream(tmp_path, std::ios::binary);
+        if (not f.is_open()) {
+            throw std::runtime_error(std::format("Could not open file {}.", tmp_path.string()));
+        }
+        f.write(value.data(), value.size());
+        f.close();
+        std::filesystem::rename(tmp_path, path);
+
+        evict();
+    }
+
+    /** Remove the least-recently used entries until the cache fits within the limit.
+     */
+    void evict()
+    {
+        struct entry_info {
+            std::filesystem::path path;
+            std::uintmax_t size;
+            std::filesystem::file_time_type time;
+        };
+
+        auto entries = std::vector<entry_info>{};
+        auto total_size = std::uintmax_t{0};
+        for (auto const& item : std::filesystem::directory_iterator(_directory)) {
+            auto ec = std::error_code{};
+            if (item.path().extension() != ".entry" or not item.is_regular_file(ec)) {
+                continue;
+            }
+
+            auto const size = item.file_size(ec);
+            auto const time = item.last_write_time(ec);
+            if (ec) {
+                continue;
+            }
+            entries.emplace_back(item.path(), size, time);
+            total_size += size;
+        }
+
+        if (total_size <= _max_size) {
+            return;
+        }
+
+        std::ranges::sort(entries, [](auto const& a, auto const& b) {
+            return a.time < b.time;
+        });
+
+        for (auto const& e : entries) {
+            if (total_size <= _max_size) {
+                break;
+            }
+
+            auto ec = std::error_code{};
+            if (std::filesystem::remove(e.path, ec)) {
+                ++_statistics.evictions;
+            }
+            total_size -= e.size;
+        }
+    }
+
+    /** The statistics of this cache object.
+     */
+    [[nodiscard]] file_cache_statistics const& statistics() const noexcept
+    {
+        return _statistics;
+    }
+
+    /** The statistics accumulated over all uses of the cache directory.
+     *
+     * The statistics are updated without locking, concurrent processes
+     * may lose some counts.
+     */
+    [[nodiscard]] file_cache_statistics load_statistics() const
+    {
+        auto r = file_cache_statistics{};
+        auto f = std::ifstream(statistics_path());
+        f >> r.hits >> r.misses >> r.evictions;
+        return f ? r : file_cache_statistics{};
+    }
+
+    /** Add the statistics of this cache object to those of the cache directory.
+     */
+    void save_statistics()
+    {
+        auto total = load_statistics();
+        total += std::exchange(_statistics, {});
+
+        auto f = std::ofstream(statistics_path());
+        f << std::format("{} {} {}\n", total.hits, total.misses, total.evictions);
+    }
+
+    /** The total size of the entries in bytes.
+     */
+    [[nodiscard]] std::uintmax_t size() const
+    {
+        auto r = std::uintmax_t{0};
+        for (auto const& item : std::filesystem::directory_iterator(_directory)) {
+            if (item.path().extension() != ".entry") {
+                continue;
+            }
+
+            auto ec = std::error_code{};
+            auto const size = item.file_size(ec);
+            if (not ec) {
+                r += size;
+            }
+        }
+        return r;
+    }
+
+    [[nodiscard]] std::uintmax_t max_size() const noexcept
+    {
+        return _max_size;
+    }
+
+private:
+    std::filesystem::path _directory;
+    std::uintmax_t _max_size;
+    file_cache_statistics _statistics = {};
+
+    [[nodiscard]] std::filesystem::path entry_path(uint64_t key) const
+    {
+        return _directory / std::format("{:016x}.entry", key);
+    }
+
+    [[nodiscard]] std::filesystem::path statistics_path() const
+    {
+        return _directory / "statistics";
+    }
+};
+
+}} // namespace csp::v1
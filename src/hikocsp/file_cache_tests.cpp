@@ -0,0 +1,117 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "file_cache.hpp"
+#include <gtest/gtest.h>
+#include <chrono>
+
+namespace file_cache_tests {
+
+/** A cache directory which is removed at the end of the test.
+ */
+class temporary_directory {
+public:
+    temporary_directory() :
+        path(std::filesystem::temp_directory_path() / std::format("hikocsp_file_cache_tests_{:08x}", std::random_device{}()))
+    {
+    }
+
+    ~temporary_directory()
+    {
+        auto ec = std::error_code{};
+        std::filesystem::remove_all(path, ec);
+    }
+
+    std::filesystem::path path;
+};
+
+} // namespace file_cache_tests
+
+static_assert(csp::fnv1a_hash("") == 0xcbf2'9ce4'8422'2325);
+static_assert(csp::fnv1a_hash("a") == 0xaf63'dc4c'8601'ec8c);
+static_assert(csp::fnv1a_hash("bar", csp::fnv1a_hash("foo")) == csp::fnv1a_hash("foobar"));
+
+TEST(file_cache, get_put)
+{
+    auto dir = file_cache_tests::temporary_directory{};
+    auto cache = csp::file_cache{dir.path, 1024};
+
+    ASSERT_EQ(cache.get(1), std::nullopt);
+    cache.put(1, "hello");
+    cache.put(2, "world");
+    ASSERT_EQ(cache.get(1), "hello");
+    ASSERT_EQ(cache.get(2), "world");
+    ASSERT_EQ(cache.get(3), std::nullopt);
+
+    cache.put(1, "foo");
+    ASSERT_EQ(cache.get(1), "foo");
+    ASSERT_EQ(cache.size(), 8);
+
+    ASSERT_EQ(cache.statistics().hits, 3);
+    ASSERT_EQ(cache.statistics().misses, 2);
+    ASSERT_EQ(cache.statistics().evictions, 0);
+    ASSERT_DOUBLE_EQ(cache.statistics().hit_rate(), 0.6);
+}
+
+TEST(file_cache, least_recently_used)
+{
+    using namespace std::chrono_literals;
+
+    auto dir = file_cache_tests::temporary_directory{};
+    auto cache = csp::file_cache{dir.path, 10};
+
+    cache.put(1, "aaaa");
+    cache.put(2, "bbbb");
+
+    // Make entry 1 more recently used than entry 2.
+    auto const now = std::filesystem::file_time_type::clock::now();
+    std::filesystem::last_write_time(dir.path / "0000000000000001.entry", now - 1min);
+    std::filesystem::last_write_time(dir.path / "0000000000000002.entry", now - 2min);
+
+    cache.put(3, "cccc");
+    ASSERT_EQ(cache.statistics().evictions, 1);
+    ASSERT_EQ(cache.get(1), "aaaa");
+    ASSERT_EQ(cache.get(2), std::nullopt);
+    ASSERT_EQ(cache.get(3), "cccc");
+    ASSERT_LE(cache.size(), 10);
+}
+
+TEST(file_cache, statistics)
+{
+    auto dir = file_cache_tests::temporary_directory{};
+
+    {
+        auto cache = csp::file_cache{dir.path, 1024};
+        ASSERT_EQ(cache.get(1), std::nullopt);
+        cache.put(1, "hello");
+        ASSERT_EQ(cache.get(1), "hello");
+        cache.save_statistics();
+        ASSERT_EQ(cache.statistics().hits, 0);
+    }
+
+    auto cache = csp::file_cache{dir.path, 1024};
+    ASSERT_EQ(cache.get(1), "hello");
+    cache.save_statistics();
+
+    auto const total = cache.load_statistics();
+    ASSERT_EQ(total.hits, 2);
+    ASSERT_EQ(total.misses, 1);
+}
+
+TEST(file_cache, validate)
+{
+    auto dir = file_cache_tests::temporary_directory{};
+    auto cache = csp::file_cache{dir.path, 1024};
+
+    cache.put(1, "hello");
+    auto const is_world = [](std::string const& value) {
+        return value == "world";
+    };
+    ASSERT_EQ(cache.get(1, is_world), std::nullopt);
+    cache.put(1, "world");
+    ASSERT_EQ(cache.get(1, is_world), "world");
+
+    ASSERT_EQ(cache.statistics().hits, 1);
+    ASSERT_EQ(cache.statistics().misses, 1);
+}
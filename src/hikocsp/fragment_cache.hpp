@@ -0,0 +1,225 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+struct fragment_cache_statistics {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+
+    /** The number of fragments removed to make room for new fragments.
+     */
+    std::size_t evictions = 0;
+
+    /** The number of fragments removed because they were older than the time-to-live.
+     */
+    std::size_t expirations = 0;
+
+    /** The fraction of lookups that were found in the cache.
+     */
+    [[nodiscard]] double hit_rate() const noexcept
+    {
+        auto const lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+    }
+};
+
+/** A thread-safe cache of rendered template fragments.
+ *
+ * This is the cache used by `${@cache key}` regions in templates. The cache is
+ * split into shards, each with its own lock and least-recently-used list, so
+ * that templates rendered on different threads rarely wait for each other.
+ *
+ * Fragments are shared, a fragment that is evicted while it is being output
+ * stays alive until the output is done.
+ */
+class fragment_cache {
+public:
+    using clock = std::chrono::steady_clock;
+    using value_type = std::shared_ptr<std::string const>;
+
+    fragment_cache(fragment_cache const&) = delete;
+    fragment_cache(fragment_cache&&) = delete;
+    fragment_cache& operator=(fragment_cache const&) = delete;
+    fragment_cache& operator=(fragment_cache&&) = delete;
+
+    /** Create a cache.
+     *
+     * @param capacity The maximum number of fragments in the cache.
+     * @param time_to_live The duration after which a fragment is rendered again.
+     * @param num_shards The number of independently locked parts of the cache.
+     */
+    explicit fragment_cache(
+        std::size_t capacity = 1024,
+        clock::duration time_to_live = clock::duration::max(),
+        std::size_t num_shards = 16) :
+        _shards(num_shards == 0 ? 1 : num_shards), _time_to_live(time_to_live)
+    {
+        auto const shard_capacity = (capacity + _shards.size() - 1) / _shards.size();
+        for (auto& shard : _shards) {
+            shard.capacity = shard_capacity == 0 ? 1 : shard_capacity;
+        }
+    }
+
+    /** Find a fragment.
+     *
+     * @param key The key of the fragment.
+     * @return The fragment, or nullptr when it is not in the cache or has expired.
+     */
+    [[nodiscard]] value_type get(std::string_view key)
+    {
+        auto& shard = shard_of(key);
+        auto const now = clock::now();
+
+        auto const lock = std::scoped_lock(shard.mutex);
+        auto const it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            _misses.fetch_add(1, std::memory_order::relaxed);
+            return nullptr;
+        }
+
+        auto const entry = it->second;
+        if (now >= entry->expires) {
+            shard.index.erase(it);
+            shard.entries.erase(entry);
+            _expirations.fetch_add(1, std::memory_order::relaxed);
+            _misses.fetch_add(1, std::memory_order::relaxed);
+            return nullptr;
+        }
+
+        // Mark the fragment as recently used.
+        shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+        _hits.fetch_add(1, std::memory_order::relaxed);
+        return entry->value;
+    }
+
+    /** Add or replace a fragment.
+     *
+     * When the shard is full the least-recently used fragment is evicted.
+     *
+     * @param key The key of the fragment.
+     * @param value The rendered fragment.
+     * @return The fragment, as it is now shared with the cache.
+     */
+    value_type put(std::string key, std::string value)
+    {
+        auto r = std::make_shared<std::string const>(std::move(value));
+
+        auto& shard = shard_of(key);
+        auto const expires = expiry(clock::now());
+
+        auto const lock = std::scoped_lock(shard.mutex);
+        if (auto const it = shard.index.find(key); it != shard.index.end()) {
+            it->second->value = r;
+            it->second->expires = expires;
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return r;
+        }
+
+        while (shard.entries.size() >= shard.capacity) {
+            shard.index.erase(shard.entries.back().key);
+            shard.entries.pop_back();
+            _evictions.fetch_add(1, std::memory_order::relaxed);
+        }
+
+        shard.entries.emplace_front(std::move(key), r, expires);
+        shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+        return r;
+    }
+
+    /** Remove all fragments.
+     *
+     * For example when the data used by the templates has changed.
+     */
+    void clear() noexcept
+    {
+        for (auto& shard : _shards) {
+            auto const lock = std::scoped_lock(shard.mutex);
+            shard.index.clear();
+            shard.entries.clear();
+        }
+    }
+
+    /** The number of fragments in the cache.
+     */
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        auto r = std::size_t{0};
+        for (auto& shard : _shards) {
+            auto const lock = std::scoped_lock(shard.mutex);
+            r += shard.entries.size();
+        }
+        return r;
+    }
+
+    [[nodiscard]] fragment_cache_statistics statistics() const noexcept
+    {
+        return {
+            _hits.load(std::memory_order::relaxed),
+            _misses.load(std::memory_order::relaxed),
+            _evictions.load(std::memory_order::relaxed),
+            _expirations.load(std::memory_order::relaxed)};
+    }
+
+private:
+    struct entry_type {
+        std::string key;
+        value_type value;
+        clock::time_point expires;
+    };
+
+    using entry_list = std::list<entry_type>;
+
+    struct shard_type {
+        mutable std::mutex mutex;
+        std::size_t capacity = 0;
+
+        /** The fragments, the most recently used first.
+         */
+        entry_list entries;
+
+        /** The fragments by key, the keys refer to the keys in `entries`.
+         */
+        std::unordered_map<std::string_view, entry_list::iterator> index;
+    };
+
+    std::vector<shard_type> _shards;
+    clock::duration _time_to_live;
+
+    std::atomic<std::size_t> _hits = 0;
+    std::atomic<std::size_t> _misses = 0;
+    std::atomic<std::size_t> _evictions = 0;
+    std::atomic<std::size_t> _expirations = 0;
+
+    [[nodiscard]] shard_type& shard_of(std::string_view key) noexcept
+    {
+        return _shards[std::hash<std::string_view>{}(key) % _shards.size()];
+    }
+
+    [[nodiscard]] clock::time_point expiry(clock::time_point now) const noexcept
+    {
+        // Saturate, the default time-to-live is forever.
+        if (_time_to_live >= clock::time_point::max() - now) {
+            return clock::time_point::max();
+        }
+        return now + _time_to_live;
+    }
+};
+
+}} // namespace csp::v1
@@ -0,0 +1,93 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "fragment_cache.hpp"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <format>
+#include <thread>
+#include <vector>
+
+TEST(fragment_cache, get_put)
+{
+    auto cache = csp::fragment_cache{};
+
+    ASSERT_EQ(cache.get("a"), nullptr);
+    ASSERT_EQ(*cache.put("a", "foo"), "foo");
+    cache.put("b", "bar");
+    ASSERT_EQ(*cache.get("a"), "foo");
+    ASSERT_EQ(*cache.get("b"), "bar");
+    ASSERT_EQ(cache.get("c"), nullptr);
+
+    cache.put("a", "baz");
+    ASSERT_EQ(*cache.get("a"), "baz");
+    ASSERT_EQ(cache.size(), 2);
+
+    ASSERT_EQ(cache.statistics().hits, 3);
+    ASSERT_EQ(cache.statistics().misses, 2);
+    ASSERT_DOUBLE_EQ(cache.statistics().hit_rate(), 0.6);
+
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_EQ(cache.get("a"), nullptr);
+}
+
+TEST(fragment_cache, least_recently_used)
+{
+    auto cache = csp::fragment_cache{2, csp::fragment_cache::clock::duration::max(), 1};
+
+    cache.put("a", "1");
+    cache.put("b", "2");
+    ASSERT_NE(cache.get("a"), nullptr);
+
+    // "b" is least recently used.
+    auto const c = cache.put("c", "3");
+    ASSERT_EQ(cache.statistics().evictions, 1);
+    ASSERT_NE(cache.get("a"), nullptr);
+    ASSERT_EQ(cache.get("b"), nullptr);
+    ASSERT_NE(cache.get("c"), nullptr);
+
+    // An evicted fragment stays valid while it is used.
+    cache.put("d", "4");
+    cache.put("e", "5");
+    ASSERT_EQ(cache.get("c"), nullptr);
+    ASSERT_EQ(*c, "3");
+}
+
+TEST(fragment_cache, time_to_live)
+{
+    auto cache = csp::fragment_cache{16, csp::fragment_cache::clock::duration::zero()};
+
+    cache.put("a", "foo");
+    ASSERT_EQ(cache.get("a"), nullptr);
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_EQ(cache.statistics().expirations, 1);
+    ASSERT_EQ(cache.statistics().misses, 1);
+}
+
+TEST(fragment_cache, threads)
+{
+    auto cache = csp::fragment_cache{64, csp::fragment_cache::clock::duration::max(), 4};
+
+    auto threads = std::vector<std::thread>{};
+    for (auto t = 0; t != 4; ++t) {
+        threads.emplace_back([&cache, t] {
+            for (auto i = 0; i != 1000; ++i) {
+                auto const key = std::format("{}", (i * 7 + t) % 100);
+                if (auto fragment = cache.get(key)) {
+                    ASSERT_EQ(*fragment, "fragment " + key);
+                } else {
+                    cache.put(key, "fragment " + key);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto const statistics = cache.statistics();
+    ASSERT_EQ(statistics.hits + statistics.misses, 4000);
+    ASSERT_LE(cache.size(), 64);
+}
@@ -10,9 +10,134 @@
 #include <cassert>
 #include <exception>
 #include <iterator>
+#include <utility>
+#include <memory>
+#include <new>
+#include <cstddef>
 
 namespace csp { inline namespace v1 {
 
+/** Yield all the elements of a nested generator.
+ *
+ * `co_yield csp::elements_of(child())` from a generator-function yields each
+ * value of the child generator, as if the child's values were yielded by the
+ * generator-function itself. Like `std::ranges::elements_of`.
+ */
+template<typename Range>
+struct elements_of {
+    Range range;
+};
+
+template<typename Range>
+elements_of(Range&&) -> elements_of<Range&&>;
+
+namespace detail {
+
+using generator_deallocate_type = void (*)(void *ptr, std::size_t size) noexcept;
+
+/** A unit of memory for a coroutine-frame, with the alignment of operator new.
+ */
+struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) generator_frame_block {
+    std::byte data[__STDCPP_DEFAULT_NEW_ALIGNMENT__];
+};
+
+[[nodiscard]] constexpr std::size_t generator_align_up(std::size_t size, std::size_t alignment) noexcept
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+/** The offset of the deallocate function pointer stored after the coroutine-frame.
+ */
+[[nodiscard]] constexpr std::size_t generator_deallocate_offset(std::size_t size) noexcept
+{
+    return generator_align_up(size, alignof(generator_deallocate_type));
+}
+
+template<typename Alloc>
+struct generator_frame_allocator {
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<generator_frame_block>;
+    using traits_type = std::allocator_traits<allocator_type>;
+
+    static_assert(std::is_pointer_v<typename traits_type::pointer>, "Fancy pointers are not supported.");
+
+    /** Stateless allocators are not stored after the coroutine-frame.
+     */
+    constexpr static bool is_stored = not traits_type::is_always_equal::value;
+
+    [[nodiscard]] constexpr static std::size_t allocator_offset(std::size_t size) noexcept
+    {
+        return generator_align_up(generator_deallocate_offset(size) + sizeof(generator_deallocate_type), alignof(allocator_type));
+    }
+
+    [[nodiscard]] constexpr static std::size_t num_blocks(std::size_t size) noexcept
+    {
+        auto const total = is_stored ? allocator_offset(size) + sizeof(allocator_type) :
+                                       generator_deallocate_offset(size) + sizeof(generator_deallocate_type);
+        return (total + sizeof(generator_frame_block) - 1) / sizeof(generator_frame_block);
+    }
+
+    [[nodiscard]] static void *allocate(Alloc const& allocator, std::size_t size)
+    {
+        auto block_allocator = allocator_type(allocator);
+        auto *ptr = reinterpret_cast<std::byte *>(traits_type::allocate(block_allocator, num_blocks(size)));
+
+        if constexpr (is_stored) {
+            new (ptr + allocator_offset(size)) allocator_type(std::move(block_allocator));
+        }
+        new (ptr + generator_deallocate_offset(size)) generator_deallocate_type(&deallocate);
+        return ptr;
+    }
+
+    static void deallocate(void *ptr, std::size_t size) noexcept
+    {
+        if constexpr (is_stored) {
+            auto& stored = *std::launder(reinterpret_cast<allocator_type *>(static_cast<std::byte *>(ptr) + allocator_offset(size)));
+            auto block_allocator = std::move(stored);
+            stored.~allocator_type();
+            traits_type::deallocate(block_allocator, static_cast<generator_frame_block *>(ptr), num_blocks(size));
+
+        } else {
+            auto block_allocator = allocator_type{};
+            traits_type::deallocate(block_allocator, static_cast<generator_frame_block *>(ptr), num_blocks(size));
+        }
+    }
+};
+
+/** Base class for promise types that allocate the coroutine-frame with an allocator.
+ *
+ * The allocator is taken from the coroutine's parameters when they start with
+ * `std::allocator_arg_t, Alloc`, optionally after the object parameter of a
+ * member function. Otherwise `std::allocator` is used.
+ */
+class generator_promise_allocation {
+public:
+    static void *operator new(std::size_t size)
+    {
+        return generator_frame_allocator<std::allocator<std::byte>>::allocate({}, size);
+    }
+
+    template<typename Alloc, typename... Args>
+    static void *operator new(std::size_t size, std::allocator_arg_t, Alloc const& allocator, Args const&...)
+    {
+        return generator_frame_allocator<Alloc>::allocate(allocator, size);
+    }
+
+    template<typename This, typename Alloc, typename... Args>
+    static void *operator new(std::size_t size, This const&, std::allocator_arg_t, Alloc const& allocator, Args const&...)
+    {
+        return generator_frame_allocator<Alloc>::allocate(allocator, size);
+    }
+
+    static void operator delete(void *ptr, std::size_t size) noexcept
+    {
+        auto const deallocate = *std::launder(
+            reinterpret_cast<generator_deallocate_type *>(static_cast<std::byte *>(ptr) + generator_deallocate_offset(size)));
+        deallocate(ptr, size);
+    }
+};
+
+} // namespace detail
+
 /** A return value for a generator-function.
  * A generator-function is a coroutine which co_yields zero or more values.
  *
@@ -22,6 +147,19 @@ namespace csp { inline namespace v1 {
  *
  * Incrementing the iterator will resume the generator-function until
  * the generator-function co_yields another value.
+ *
+ * A generator-function may delegate to another generator using
+ * `co_yield csp::elements_of(child)`. The iterator then resumes the innermost
+ * generator directly; when it finishes control is transferred symmetrically
+ * back to its parent. The cost per value is therefor independent of the
+ * nesting depth.
+ *
+ * The coroutine-frame is allocated with `std::allocator` by default. A
+ * generator-function that has a `std::allocator_arg_t` parameter followed by an
+ * allocator, as its first parameters or directly after the object parameter,
+ * allocates its frame with that allocator instead. For example by passing a
+ * `std::pmr::polymorphic_allocator` to a `std::pmr::monotonic_buffer_resource`
+ * all frames of a request can be released at once.
  */
 template<typename T>
 class generator {
@@ -31,35 +169,85 @@ public:
     static_assert(not std::is_reference_v<value_type>);
     static_assert(not std::is_const_v<value_type>);
 
-    class promise_type {
+    class promise_type;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    class promise_type : public detail::generator_promise_allocation {
     public:
         generator get_return_object()
         {
-            return generator{handle_type::from_promise(*this)};
+            auto const handle = handle_type::from_promise(*this);
+            _leaf = handle;
+            return generator{handle};
         }
 
-        value_type const& value() const noexcept
+        value_type& value() const noexcept
         {
             assert(_value_ptr != nullptr);
             return *_value_ptr;
         }
 
-        static std::suspend_never initial_suspend() noexcept
+        static std::suspend_always initial_suspend() noexcept
         {
             return {};
         }
 
-        static std::suspend_always final_suspend() noexcept
+        static auto final_suspend() noexcept
         {
-            return {};
+            return final_awaiter{};
         }
 
-        std::suspend_always yield_value(value_type const &arg) noexcept
+        /** Yield an rvalue.
+         *
+         * The consumer may move the value out of the generator.
+         */
+        std::suspend_always yield_value(value_type&& arg) noexcept
         {
             _value_ptr = std::addressof(arg);
             return {};
         }
 
+        /** Yield an lvalue.
+         *
+         * Since the consumer may move from the value, a copy is stored in
+         * the coroutine-frame. Use `std::move()` to yield without a copy.
+         */
+        auto yield_value(value_type const& arg) noexcept(std::is_nothrow_copy_constructible_v<value_type>)
+        {
+            return converted_awaiter{arg};
+        }
+
+        /** Yield a value which is only explicitly convertible to value_type.
+         *
+         * For example a `std::string_view` yielded from a `generator<std::string>`.
+         * The converted value is stored in the awaiter, which lives in the
+         * coroutine-frame until the generator-function is resumed.
+         */
+        template<typename Arg>
+            requires(std::constructible_from<value_type, Arg> and not std::convertible_to<Arg, value_type const&>)
+        auto yield_value(Arg&& arg) noexcept(std::is_nothrow_constructible_v<value_type, Arg>)
+        {
+            return converted_awaiter{value_type(std::forward<Arg>(arg))};
+        }
+
+        /** Yield all values of a nested generator.
+         *
+         * When @a nested is an rvalue the nested generator is owned, and
+         * destroyed, by this generator-function.
+         */
+        template<typename Generator>
+            requires std::same_as<std::remove_cvref_t<Generator>, generator>
+        auto yield_value(elements_of<Generator> nested) noexcept
+        {
+            if constexpr (std::is_lvalue_reference_v<Generator>) {
+                return nested_awaiter{generator{}, nested.range._coroutine};
+            } else {
+                auto owner = generator{std::move(nested.range)};
+                auto const child = owner._coroutine;
+                return nested_awaiter{std::move(owner), child};
+            }
+        }
+
         void return_void() noexcept {}
 
         // Disallow co_await in generator coroutines.
@@ -80,64 +268,131 @@ public:
         }
 
     private:
+        struct converted_awaiter {
+            value_type value;
+
+            [[nodiscard]] bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(handle_type handle) noexcept
+            {
+                handle.promise()._value_ptr = std::addressof(value);
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        struct nested_awaiter {
+            generator owner;
+            handle_type child;
+
+            [[nodiscard]] bool await_ready() const noexcept
+            {
+                return not child or child.done();
+            }
+
+            std::coroutine_handle<> await_suspend(handle_type handle) noexcept
+            {
+                auto& parent = handle.promise();
+                auto& nested = child.promise();
+
+                nested._parent = handle;
+                nested._root = parent._root;
+                nested._root->_leaf = child;
+                return child;
+            }
+
+            void await_resume()
+            {
+                if (child) {
+                    child.promise().rethrow();
+                }
+            }
+        };
+
+        struct final_awaiter {
+            [[nodiscard]] bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(handle_type handle) noexcept
+            {
+                auto& promise = handle.promise();
+                if (auto parent = promise._parent) {
+                    // Continue the generator-function that delegated to this one.
+                    promise._root->_leaf = parent;
+                    return parent;
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
         std::exception_ptr _exception = nullptr;
-        value_type const *_value_ptr = nullptr;
-    };
+        value_type *_value_ptr = nullptr;
 
-    using handle_type = std::coroutine_handle<promise_type>;
+        /** The outermost generator, which is being iterated over.
+         */
+        promise_type *_root = this;
 
-    class value_proxy {
-    public:
-        value_proxy(value_type const& value) noexcept : _value(value) {}
+        /** The generator that delegated to this generator.
+         */
+        handle_type _parent = {};
 
-        value_type const& operator*() const noexcept
-        {
-            return _value;
-        }
+        /** The innermost generator that produces the values; only used by the root.
+         */
+        handle_type _leaf = {};
 
-    private:
-        value_type _value;
+        friend class generator;
     };
 
-    /** A forward iterator which iterates through values co_yieled by the generator-function.
+    /** An input iterator which iterates through values co_yieled by the generator-function.
+     *
+     * @tparam IsConst When false the yielded value may be modified or moved from.
      */
-    class const_iterator {
+    template<bool IsConst>
+    class basic_iterator {
     public:
         using difference_type = ptrdiff_t;
-        using value_type = std::decay_t<value_type>;
-        using pointer = value_type const *;
-        using reference = value_type const&;
+        using value_type = std::decay_t<T>;
+        using pointer = std::conditional_t<IsConst, value_type const *, value_type *>;
+        using reference = std::conditional_t<IsConst, value_type const&, value_type&>;
         using iterator_category = std::input_iterator_tag;
 
-        explicit const_iterator(handle_type coroutine) : _coroutine{coroutine} {}
+        explicit basic_iterator(handle_type coroutine) : _coroutine{coroutine} {}
 
         /** Resume the generator-function.
          */
-        const_iterator& operator++()
+        basic_iterator& operator++()
         {
-            _coroutine.resume();
+            _coroutine.promise()._leaf.resume();
             _coroutine.promise().rethrow();
             return *this;
         }
 
-        value_proxy operator++(int)
+        /** Resume the generator-function.
+         *
+         * The previous value is not retained, as it would need to be copied.
+         */
+        void operator++(int)
         {
-            auto tmp = value_proxy(_coroutine.promise().value());
-            _coroutine.resume();
-            _coroutine.promise().rethrow();
-            return tmp;
+            ++*this;
         }
 
         /** Retrieve the value co_yielded by the generator-function.
          */
-        decltype(auto) operator*() const
+        reference operator*() const
         {
-            return _coroutine.promise().value();
+            return _coroutine.promise()._leaf.promise().value();
         }
 
         pointer operator->() const noexcept
         {
-            return std::addressof(_coroutine.promise().value());
+            return std::addressof(**this);
         }
 
         [[nodiscard]] bool at_end() const noexcept
@@ -156,6 +411,9 @@ public:
         handle_type _coroutine;
     };
 
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
     explicit generator(handle_type coroutine) : _coroutine(coroutine) {}
 
     generator() = default;
@@ -173,7 +431,10 @@ public:
 
     generator& operator=(generator&& other) noexcept
     {
-        hi_return_on_self_assignment(other);
+        if (this == std::addressof(other)) {
+            return *this;
+        }
+
         if (_coroutine) {
             _coroutine.destroy();
         }
@@ -182,16 +443,20 @@ public:
     }
 
     /** Start the generator-function and return an iterator.
+     *
+     * The values can be moved out of the generator through this iterator.
      */
-    const_iterator begin() const
+    iterator begin() const
     {
-        return const_iterator{_coroutine};
+        start();
+        return iterator{_coroutine};
     }
 
     /** Start the generator-function and return an iterator.
      */
     const_iterator cbegin() const
     {
+        start();
         return const_iterator{_coroutine};
     }
 
@@ -211,6 +476,24 @@ public:
 
 private:
     handle_type _coroutine;
+
+    /** Run the generator-function until it yields its first value.
+     *
+     * The generator-function is started lazily, so that it can be moved into
+     * a parent generator-function through `elements_of` before it is started.
+     */
+    void start() const
+    {
+        if (not _coroutine or _coroutine.done()) {
+            return;
+        }
+
+        auto& promise = _coroutine.promise();
+        if (promise._leaf == _coroutine and promise._value_ptr == nullptr) {
+            _coroutine.resume();
+            promise.rethrow();
+        }
+    }
 };
 
 }} // namespace csp::v1
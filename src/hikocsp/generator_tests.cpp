@@ -6,6 +6,11 @@
 #include <gtest/gtest.h>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <stdexcept>
+#include <memory_resource>
+#include <array>
+#include <memory>
 
 namespace generator_tests {
 
@@ -16,8 +21,150 @@ csp::generator<int> my_generator()
     co_yield 12;
 }
 
+csp::generator<int> empty_generator()
+{
+    co_return;
+}
+
+csp::generator<int> nested_generator()
+{
+    co_yield 1;
+    co_yield csp::elements_of(my_generator());
+    co_yield csp::elements_of(empty_generator());
+    co_yield 2;
+    co_yield csp::elements_of(my_generator());
+}
+
+csp::generator<int> recursive_generator(int depth)
+{
+    co_yield depth;
+    if (depth != 0) {
+        co_yield csp::elements_of(recursive_generator(depth - 1));
+    }
+    co_yield -depth;
+}
+
+csp::generator<int> throwing_generator()
+{
+    co_yield 1;
+    throw std::runtime_error("throwing_generator");
+}
+
+csp::generator<int> catching_generator()
+{
+    auto caught = false;
+    try {
+        co_yield csp::elements_of(throwing_generator());
+    } catch (std::runtime_error const&) {
+        caught = true;
+    }
+
+    if (caught) {
+        co_yield 2;
+    }
+}
+
+csp::generator<int> lvalue_nested_generator()
+{
+    auto child = my_generator();
+    co_yield csp::elements_of(child);
+    co_yield 4;
+}
+
+class counting_resource : public std::pmr::memory_resource {
+public:
+    int num_allocations = 0;
+    int num_deallocations = 0;
+
+    explicit counting_resource(std::pmr::memory_resource *upstream) noexcept : _upstream(upstream) {}
+
+private:
+    std::pmr::memory_resource *_upstream;
+
+    void *do_allocate(std::size_t size, std::size_t alignment) override
+    {
+        ++num_allocations;
+        return _upstream->allocate(size, alignment);
+    }
+
+    void do_deallocate(void *ptr, std::size_t size, std::size_t alignment) override
+    {
+        ++num_deallocations;
+        _upstream->deallocate(ptr, size, alignment);
+    }
+
+    [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+// GCC reports a coroutine whose frame is allocated by a templated operator new,
+// and released by the usual operator delete, as a mismatch.
+#if defined(__GNUC__) and not defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+csp::generator<int> allocated_generator(std::allocator_arg_t, std::pmr::polymorphic_allocator<> allocator, int depth)
+{
+    co_yield depth;
+    if (depth != 0) {
+        co_yield csp::elements_of(allocated_generator(std::allocator_arg, allocator, depth - 1));
+    }
+}
+
+struct allocated_page {
+    int value;
+
+    csp::generator<int> render(std::allocator_arg_t, std::pmr::polymorphic_allocator<>) const
+    {
+        co_yield value;
+    }
+};
+
+#if defined(__GNUC__) and not defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+struct copy_counter {
+    int value = 0;
+    int num_copies = 0;
+
+    copy_counter(int value) noexcept : value(value) {}
+    copy_counter(copy_counter const& other) noexcept : value(other.value), num_copies(other.num_copies + 1) {}
+    copy_counter(copy_counter&& other) noexcept = default;
+    copy_counter& operator=(copy_counter const& other) = delete;
+    copy_counter& operator=(copy_counter&& other) noexcept = default;
+};
+
+csp::generator<copy_counter> copy_counter_generator()
+{
+    co_yield copy_counter{1};
+
+    auto lvalue = copy_counter{2};
+    co_yield lvalue;
+    co_yield std::move(lvalue);
+}
+
+csp::generator<std::unique_ptr<int>> unique_generator()
+{
+    co_yield std::make_unique<int>(1);
+    co_yield std::make_unique<int>(2);
 }
 
+template<typename Generator>
+[[nodiscard]] std::vector<int> to_vector(Generator const& g)
+{
+    auto r = std::vector<int>{};
+    for (auto x : g) {
+        r.push_back(x);
+    }
+    return r;
+}
+
+} // namespace generator_tests
+
 TEST(generator, generator)
 {
     auto test = generator_tests::my_generator();
@@ -52,3 +199,104 @@ TEST(generator, generator_loop)
     }
 }
 
+
+TEST(generator, lazy_start)
+{
+    auto started = false;
+    auto test = [](bool& started) -> csp::generator<int> {
+        started = true;
+        co_yield 1;
+    }(started);
+
+    ASSERT_FALSE(started);
+    auto it = test.begin();
+    ASSERT_TRUE(started);
+    ASSERT_EQ(*it, 1);
+}
+
+TEST(generator, elements_of)
+{
+    ASSERT_EQ(generator_tests::to_vector(generator_tests::nested_generator()), (std::vector{1, 42, 3, 12, 2, 42, 3, 12}));
+}
+
+TEST(generator, elements_of_lvalue)
+{
+    ASSERT_EQ(generator_tests::to_vector(generator_tests::lvalue_nested_generator()), (std::vector{42, 3, 12, 4}));
+}
+
+TEST(generator, elements_of_recursive)
+{
+    ASSERT_EQ(generator_tests::to_vector(generator_tests::recursive_generator(3)), (std::vector{3, 2, 1, 0, 0, -1, -2, -3}));
+
+    // Deep nesting should not overflow the stack, since each generator is resumed directly.
+    auto count = 0;
+    for (auto x : generator_tests::recursive_generator(10000)) {
+        (void)x;
+        ++count;
+    }
+    ASSERT_EQ(count, 20002);
+}
+
+TEST(generator, elements_of_exception)
+{
+    ASSERT_EQ(generator_tests::to_vector(generator_tests::catching_generator()), (std::vector{1, 2}));
+
+    auto test = [] () -> csp::generator<int> {
+        co_yield csp::elements_of(generator_tests::throwing_generator());
+    }();
+
+    auto it = test.begin();
+    ASSERT_EQ(*it, 1);
+    ASSERT_THROW(++it, std::runtime_error);
+    ASSERT_EQ(it, test.end());
+}
+
+TEST(generator, allocator)
+{
+    auto buffer = std::array<std::byte, 4096>{};
+    auto arena = std::pmr::monotonic_buffer_resource{buffer.data(), buffer.size(), std::pmr::null_memory_resource()};
+    auto resource = generator_tests::counting_resource{&arena};
+
+    ASSERT_EQ(
+        generator_tests::to_vector(generator_tests::allocated_generator(std::allocator_arg, &resource, 3)),
+        (std::vector{3, 2, 1, 0}));
+    ASSERT_EQ(resource.num_allocations, 4);
+    ASSERT_EQ(resource.num_deallocations, 4);
+
+    auto const page = generator_tests::allocated_page{5};
+    ASSERT_EQ(generator_tests::to_vector(page.render(std::allocator_arg, &resource)), (std::vector{5}));
+    ASSERT_EQ(resource.num_allocations, 5);
+    ASSERT_EQ(resource.num_deallocations, 5);
+}
+
+TEST(generator, move_values)
+{
+    auto values = std::vector<generator_tests::copy_counter>{};
+    for (auto& value : generator_tests::copy_counter_generator()) {
+        values.push_back(std::move(value));
+    }
+
+    ASSERT_EQ(values.size(), 3);
+    ASSERT_EQ(values[0].value, 1);
+    ASSERT_EQ(values[0].num_copies, 0);
+    // An lvalue is copied, so that the generator-function's variable is not moved from.
+    ASSERT_EQ(values[1].value, 2);
+    ASSERT_EQ(values[1].num_copies, 1);
+    ASSERT_EQ(values[2].value, 2);
+    ASSERT_EQ(values[2].num_copies, 0);
+}
+
+TEST(generator, move_only)
+{
+    auto test = generator_tests::unique_generator();
+    auto it = test.begin();
+
+    auto first = std::move(*it);
+    it++;
+    auto second = std::move(*it);
+    ++it;
+    ASSERT_EQ(it, test.end());
+
+    ASSERT_EQ(*first, 1);
+    ASSERT_EQ(*second, 2);
+}
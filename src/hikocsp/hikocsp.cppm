@@ -0,0 +1,51 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+/** The run-time library used by generated templates, as a module.
+ *
+ * Templates translated with `--module` import this module, so that code
+ * importing a template does not parse these headers again.
+ */
+
+module;
+
+#include "generator.hpp"
+#include "async_generator.hpp"
+#include "resumable_buffer.hpp"
+#include "fragment_cache.hpp"
+#include "parallel_sections.hpp"
+#include "profiler.hpp"
+#include "static_template.hpp"
+#include "csp_error.hpp"
+
+export module hikocsp;
+
+export namespace csp {
+
+using csp::elements_of;
+using csp::generator;
+
+using csp::scheduler;
+using csp::inline_scheduler;
+using csp::async_generator;
+
+using csp::resumable_buffer;
+
+using csp::fragment_cache_statistics;
+using csp::fragment_cache;
+
+using csp::parallel_sections;
+using csp::inline_executor;
+
+using csp::profile_entry;
+using csp::profile_site;
+using csp::profile_report;
+using csp::dump_profile;
+
+using csp::fixed_string;
+using csp::static_template;
+
+using csp::csp_error;
+
+} // namespace csp
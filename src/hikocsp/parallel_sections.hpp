@@ -0,0 +1,130 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <latch>
+#include <mutex>
+#include <exception>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+/** The sections of a `${@parallel executor}` block.
+ *
+ * Each section is rendered into its own string by a task passed to the
+ * executor. After `wait()` the strings are output in document order.
+ */
+class parallel_sections {
+public:
+    parallel_sections(parallel_sections const&) = delete;
+    parallel_sections(parallel_sections&&) = delete;
+    parallel_sections& operator=(parallel_sections const&) = delete;
+    parallel_sections& operator=(parallel_sections&&) = delete;
+
+    /** Create the sections.
+     *
+     * @param num_sections The number of sections, each must be run exactly once.
+     */
+    explicit parallel_sections(std::size_t num_sections) : _texts(num_sections), _latch(static_cast<std::ptrdiff_t>(num_sections)) {}
+
+    /** Wait for the running sections.
+     *
+     * The sections refer to the variables of the template, when an exception
+     * is thrown the tasks that are already running must finish first.
+     */
+    ~parallel_sections()
+    {
+        if (auto const num_not_started = _texts.size() - _num_started) {
+            _latch.count_down(static_cast<std::ptrdiff_t>(num_not_started));
+        }
+        _latch.wait();
+    }
+
+    /** Render a section.
+     *
+     * @param executor A callable object which is called with a `std::function<void()>`
+     *                 and runs it, for example on a thread pool.
+     * @param index The index of the section.
+     * @param function The function rendering the section, called with a reference
+     *                 to the section's `std::string`.
+     */
+    template<typename Executor, typename Function>
+    void run(Executor&& executor, std::size_t index, Function function)
+    {
+        auto task = std::function<void()>{[this, index, function = std::move(function)]() mutable {
+            try {
+                function(_texts[index]);
+            } catch (...) {
+                auto const lock = std::scoped_lock(_mutex);
+                if (not _exception) {
+                    _exception = std::current_exception();
+                }
+            }
+            _latch.count_down();
+        }};
+
+        ++_num_started;
+        try {
+            std::forward<Executor>(executor)(std::move(task));
+        } catch (...) {
+            // The task was not run.
+            _latch.count_down();
+            throw;
+        }
+    }
+
+    /** Wait until all sections are rendered.
+     *
+     * @return The text of each section, in order.
+     * @throws The first exception thrown while rendering a section.
+     */
+    [[nodiscard]] std::vector<std::string> const& wait()
+    {
+        _latch.wait();
+        if (_exception) {
+            std::rethrow_exception(_exception);
+        }
+        return _texts;
+    }
+
+    /** Wait until all sections are rendered.
+     *
+     * @return The text of all sections concatenated.
+     * @throws The first exception thrown while rendering a section.
+     */
+    [[nodiscard]] std::string join()
+    {
+        auto r = std::string{};
+        for (auto const& text : wait()) {
+            r += text;
+        }
+        return r;
+    }
+
+private:
+    std::vector<std::string> _texts;
+    std::size_t _num_started = 0;
+    std::latch _latch;
+    std::mutex _mutex;
+    std::exception_ptr _exception;
+};
+
+/** An executor which runs a task immediately on the current thread.
+ *
+ * Useful for rendering a template with parallel sections sequentially, for
+ * example when debugging.
+ */
+struct inline_executor {
+    void operator()(std::function<void()> const& task) const
+    {
+        task();
+    }
+};
+
+}} // namespace csp::v1
@@ -0,0 +1,69 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "parallel_sections.hpp"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(parallel_sections, threads)
+{
+    auto threads = std::vector<std::jthread>{};
+    auto const executor = [&threads](std::function<void()> task) {
+        threads.emplace_back(std::move(task));
+    };
+
+    auto sections = csp::parallel_sections{3};
+    for (auto i = std::size_t{0}; i != 3; ++i) {
+        sections.run(executor, i, [i](std::string& text) {
+            for (auto j = 0; j != 1000; ++j) {
+                text += static_cast<char>('a' + i);
+            }
+        });
+    }
+
+    auto const& texts = sections.wait();
+    ASSERT_EQ(texts.size(), 3);
+    ASSERT_EQ(texts[0], std::string(1000, 'a'));
+    ASSERT_EQ(texts[1], std::string(1000, 'b'));
+    ASSERT_EQ(texts[2], std::string(1000, 'c'));
+}
+
+TEST(parallel_sections, join)
+{
+    auto sections = csp::parallel_sections{2};
+    sections.run(csp::inline_executor{}, 1, [](std::string& text) {
+        text = "bar";
+    });
+    sections.run(csp::inline_executor{}, 0, [](std::string& text) {
+        text = "foo";
+    });
+
+    ASSERT_EQ(sections.join(), "foobar");
+}
+
+TEST(parallel_sections, exception)
+{
+    auto sections = csp::parallel_sections{2};
+    sections.run(csp::inline_executor{}, 0, [](std::string&) {
+        throw std::runtime_error("foo");
+    });
+    sections.run(csp::inline_executor{}, 1, [](std::string& text) {
+        text = "bar";
+    });
+
+    ASSERT_THROW((void)sections.wait(), std::runtime_error);
+}
+
+TEST(parallel_sections, executor_exception)
+{
+    auto const executor = [](std::function<void()> const&) {
+        throw std::runtime_error("full");
+    };
+
+    // The destructor must not wait for the sections that were never started.
+    auto sections = csp::parallel_sections{2};
+    ASSERT_THROW(sections.run(executor, 0, [](std::string&) {}), std::runtime_error);
+}
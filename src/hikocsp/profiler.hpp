@@ -0,0 +1,269 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <ostream>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+/** The counters of a profile site, summed over all threads.
+ */
+struct profile_entry {
+    std::string_view path;
+    int line_nr = 0;
+
+    /** The kind of output: "text", "escape" or "placeholder".
+     */
+    std::string_view kind;
+
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+    std::chrono::nanoseconds duration = {};
+};
+
+namespace detail {
+
+/** The counters of a single site, written only by the thread owning the table.
+ */
+struct profile_counters {
+    std::atomic<uint64_t> calls = 0;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> nanoseconds = 0;
+
+    void record(uint64_t num_bytes, uint64_t num_nanoseconds) noexcept
+    {
+        // Only the owning thread writes, so a read-modify-write is not needed.
+        calls.store(calls.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+        bytes.store(bytes.load(std::memory_order::relaxed) + num_bytes, std::memory_order::relaxed);
+        nanoseconds.store(nanoseconds.load(std::memory_order::relaxed) + num_nanoseconds, std::memory_order::relaxed);
+    }
+};
+
+/** The counters of all sites for a single thread.
+ *
+ * The counters are allocated in chunks which are never moved, so that the
+ * profile can be read by another thread without locking.
+ */
+class profile_table {
+public:
+    constexpr static std::size_t chunk_size = 1024;
+    constexpr static std::size_t max_chunks = 256;
+
+    ~profile_table()
+    {
+        for (auto& chunk : _chunks) {
+            delete[] chunk.load(std::memory_order::relaxed);
+        }
+    }
+
+    /** Get the counters of a site, allocating them when needed.
+     *
+     * Must only be called by the owning thread.
+     */
+    [[nodiscard]] profile_counters *get(std::size_t id) noexcept
+    {
+        auto const chunk_nr = id / chunk_size;
+        if (chunk_nr >= max_chunks) {
+            return nullptr;
+        }
+
+        auto chunk = _chunks[chunk_nr].load(std::memory_order::relaxed);
+        if (chunk == nullptr) {
+            chunk = new (std::nothrow) profile_counters[chunk_size];
+            if (chunk == nullptr) {
+                return nullptr;
+            }
+            _chunks[chunk_nr].store(chunk, std::memory_order::release);
+        }
+        return chunk + id % chunk_size;
+    }
+
+    /** Find the counters of a site, or nullptr when the thread has not used the site.
+     */
+    [[nodiscard]] profile_counters const *find(std::size_t id) const noexcept
+    {
+        auto const chunk_nr = id / chunk_size;
+        if (chunk_nr >= max_chunks) {
+            return nullptr;
+        }
+
+        auto const chunk = _chunks[chunk_nr].load(std::memory_order::acquire);
+        return chunk == nullptr ? nullptr : chunk + id % chunk_size;
+    }
+
+private:
+    std::array<std::atomic<profile_counters *>, max_chunks> _chunks = {};
+};
+
+struct profile_site_info {
+    std::string_view path;
+    int line_nr;
+    std::string_view kind;
+};
+
+/** The sites and the tables of all threads.
+ *
+ * The lock is only taken when a site is first used, or a thread records its
+ * first sample.
+ */
+struct profile_registry {
+    std::mutex mutex;
+    std::vector<profile_site_info> sites;
+
+    /** The tables are kept after a thread exits, so that its counts are reported.
+     */
+    std::vector<std::shared_ptr<profile_table>> tables;
+
+    [[nodiscard]] static profile_registry& global() noexcept
+    {
+        static auto r = profile_registry{};
+        return r;
+    }
+};
+
+[[nodiscard]] inline profile_table& thread_profile_table()
+{
+    thread_local auto const table = [] {
+        auto r = std::make_shared<profile_table>();
+        auto& registry = profile_registry::global();
+        auto const lock = std::scoped_lock(registry.mutex);
+        registry.tables.push_back(r);
+        return r;
+    }();
+    return *table;
+}
+
+} // namespace detail
+
+/** A place in a template where output is measured.
+ *
+ * The code generated with the `--instrument` option declares a static
+ * profile_site for each piece of text and placeholder.
+ */
+class profile_site {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /** Register a site.
+     *
+     * @param path The path of the template, must be a string-literal.
+     * @param line_nr The line in the template.
+     * @param kind The kind of output, must be a string-literal.
+     */
+    profile_site(char const *path, int line_nr, char const *kind)
+    {
+        auto& registry = detail::profile_registry::global();
+        auto const lock = std::scoped_lock(registry.mutex);
+        _id = registry.sites.size();
+        registry.sites.emplace_back(path, line_nr, kind);
+    }
+
+    /** Count output of static text.
+     *
+     * @param text The text to output.
+     * @return The @a text.
+     */
+    template<typename Text>
+    [[nodiscard]] Text&& count(Text&& text)
+    {
+        if (auto counters = detail::thread_profile_table().get(_id)) {
+            if constexpr (std::is_array_v<std::remove_reference_t<Text>>) {
+                // A string-literal, which may contain nul characters.
+                counters->record(std::extent_v<std::remove_reference_t<Text>> - 1, 0);
+            } else {
+                counters->record(std::string_view{text}.size(), 0);
+            }
+        }
+        return std::forward<Text>(text);
+    }
+
+    /** Measure the rendering of a placeholder.
+     *
+     * @param function The function rendering the placeholder.
+     * @return The result of @a function.
+     */
+    template<typename Function>
+    [[nodiscard]] auto measure(Function&& function)
+    {
+        auto const start = clock::now();
+        auto r = std::forward<Function>(function)();
+        auto const duration = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+
+        if (auto counters = detail::thread_profile_table().get(_id)) {
+            counters->record(std::string_view{r}.size(), static_cast<uint64_t>(duration.count()));
+        }
+        return r;
+    }
+
+private:
+    std::size_t _id = 0;
+};
+
+/** Get the profile of all sites that were used.
+ *
+ * May be called while templates are rendered on other threads.
+ *
+ * @return The counters of each site, summed over all threads, the site
+ *         with the longest duration first.
+ */
+[[nodiscard]] inline std::vector<profile_entry> profile_report()
+{
+    auto& registry = detail::profile_registry::global();
+    auto const lock = std::scoped_lock(registry.mutex);
+
+    auto r = std::vector<profile_entry>{};
+    for (auto id = std::size_t{0}; id != registry.sites.size(); ++id) {
+        auto entry = profile_entry{registry.sites[id].path, registry.sites[id].line_nr, registry.sites[id].kind};
+        for (auto const& table : registry.tables) {
+            if (auto counters = table->find(id)) {
+                entry.calls += counters->calls.load(std::memory_order::relaxed);
+                entry.bytes += counters->bytes.load(std::memory_order::relaxed);
+                entry.duration += std::chrono::nanoseconds{counters->nanoseconds.load(std::memory_order::relaxed)};
+            }
+        }
+        if (entry.calls != 0) {
+            r.push_back(entry);
+        }
+    }
+
+    std::stable_sort(r.begin(), r.end(), [](auto const& a, auto const& b) {
+        return a.duration > b.duration;
+    });
+    return r;
+}
+
+/** Write the profile as a table.
+ */
+inline void dump_profile(std::ostream& out)
+{
+    out << std::format("{:>12} {:>12} {:>14}  {}\n", "calls", "bytes", "time (ns)", "site");
+    for (auto const& entry : profile_report()) {
+        out << std::format(
+            "{:>12} {:>12} {:>14}  {}:{} {}\n",
+            entry.calls,
+            entry.bytes,
+            entry.duration.count(),
+            entry.path,
+            entry.line_nr,
+            entry.kind);
+    }
+}
+
+}} // namespace csp::v1
@@ -0,0 +1,78 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "profiler.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+namespace profiler_tests {
+
+[[nodiscard]] csp::profile_entry find(std::string_view path, int line_nr)
+{
+    auto const report = csp::profile_report();
+    auto it = std::find_if(report.begin(), report.end(), [&](auto const& entry) {
+        return entry.path == path and entry.line_nr == line_nr;
+    });
+    return it == report.end() ? csp::profile_entry{} : *it;
+}
+
+} // namespace profiler_tests
+
+TEST(profiler, count)
+{
+    static auto site = csp::profile_site{"profiler_tests.csp", 1, "text"};
+
+    ASSERT_EQ(std::string_view{site.count("foo")}, "foo");
+    ASSERT_EQ(site.count(std::string_view{"a\0b", 3}), std::string_view("a\0b", 3));
+
+    auto const entry = profiler_tests::find("profiler_tests.csp", 1);
+    ASSERT_EQ(entry.kind, "text");
+    ASSERT_EQ(entry.calls, 2);
+    ASSERT_EQ(entry.bytes, 6);
+    ASSERT_EQ(entry.duration.count(), 0);
+}
+
+TEST(profiler, measure)
+{
+    static auto site = csp::profile_site{"profiler_tests.csp", 2, "placeholder"};
+
+    ASSERT_EQ(site.measure([] {
+        return std::string(100, 'x');
+    }),
+        std::string(100, 'x'));
+
+    auto const entry = profiler_tests::find("profiler_tests.csp", 2);
+    ASSERT_EQ(entry.calls, 1);
+    ASSERT_EQ(entry.bytes, 100);
+}
+
+TEST(profiler, threads)
+{
+    static auto site = csp::profile_site{"profiler_tests.csp", 3, "placeholder"};
+
+    auto threads = std::vector<std::thread>{};
+    for (auto t = 0; t != 4; ++t) {
+        threads.emplace_back([] {
+            for (auto i = 0; i != 100; ++i) {
+                (void)site.measure([] {
+                    return std::string{"foo"};
+                });
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // The counts of threads that have exited are kept.
+    auto const entry = profiler_tests::find("profiler_tests.csp", 3);
+    ASSERT_EQ(entry.calls, 400);
+    ASSERT_EQ(entry.bytes, 1200);
+
+    auto out = std::ostringstream{};
+    csp::dump_profile(out);
+    ASSERT_NE(out.str().find("profiler_tests.csp:3 placeholder"), std::string::npos);
+}
@@ -0,0 +1,127 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <algorithm>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+/** The output of a template translated with the `--resumable` option.
+ *
+ * The template fills a caller-provided buffer. When the buffer is full the
+ * template returns from its function and records the resume-point in
+ * `state`; on the next call the template's `switch (state)` continues after
+ * the text that was last appended.
+ *
+ * Text that does not fit in the buffer is retained and copied at the start of
+ * the next buffer. The memory for this is reused between buffers.
+ */
+class resumable_buffer {
+public:
+    /** The resume-point of the template.
+     *
+     * Zero is the start of the template, `finished` after the template
+     * has completed.
+     */
+    int state = 0;
+
+    constexpr static int finished = -1;
+
+    /** Start filling a new buffer.
+     *
+     * Text that did not fit in the previous buffer is copied first.
+     *
+     * @param buffer The buffer to fill, must not be empty.
+     * @return true if the template should continue, false if the buffer
+     *         is already full.
+     */
+    [[nodiscard]] bool start(std::span<char> buffer) noexcept
+    {
+        _first = buffer.data();
+        _it = _first;
+        _last = _first + buffer.size();
+
+        auto const n = std::min(_pending.size() - _pending_offset, room());
+        _it = std::copy_n(_pending.data() + _pending_offset, n, _it);
+        _pending_offset += n;
+        if (_pending_offset != _pending.size()) {
+            return false;
+        }
+
+        _pending.clear();
+        _pending_offset = 0;
+        return _it != _last;
+    }
+
+    /** Append text.
+     *
+     * @param str The text to append to the buffer.
+     * @return true if the template should continue, false if the buffer is full.
+     */
+    [[nodiscard]] bool append(std::string_view str)
+    {
+        auto const n = std::min(str.size(), room());
+        _it = std::copy_n(str.data(), n, _it);
+        if (n != str.size()) {
+            _pending.assign(str.substr(n));
+            _pending_offset = 0;
+        }
+        return _it != _last;
+    }
+
+    /** Suspend the template.
+     *
+     * @param resume_point The resume-point from where the template continues.
+     * @return The number of characters written in the buffer.
+     */
+    std::size_t suspend(int resume_point) noexcept
+    {
+        state = resume_point;
+        return size();
+    }
+
+    /** Mark the template as finished.
+     *
+     * @return The number of characters written in the buffer.
+     */
+    std::size_t finish() noexcept
+    {
+        state = finished;
+        return size();
+    }
+
+    /** The template has finished and all text was written.
+     */
+    [[nodiscard]] bool done() const noexcept
+    {
+        return state == finished and _pending_offset == _pending.size();
+    }
+
+    /** The number of characters written in the current buffer.
+     */
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return static_cast<std::size_t>(_it - _first);
+    }
+
+private:
+    char *_first = nullptr;
+    char *_it = nullptr;
+    char *_last = nullptr;
+
+    std::string _pending = {};
+    std::size_t _pending_offset = 0;
+
+    [[nodiscard]] std::size_t room() const noexcept
+    {
+        return static_cast<std::size_t>(_last - _it);
+    }
+};
+
+}} // namespace csp::v1
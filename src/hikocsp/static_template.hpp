@@ -0,0 +1,309 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "csp_parser.hpp"
+#include "csp_error.hpp"
+#include <string>
+#include <string_view>
+#include <array>
+#include <tuple>
+#include <format>
+#include <concepts>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+namespace csp { inline namespace v1 {
+
+/** A string-literal that can be used as a template argument.
+ */
+template<std::size_t N>
+struct fixed_string {
+    char value[N] = {};
+
+    constexpr fixed_string(char const (&str)[N]) noexcept
+    {
+        std::copy_n(str, N, value);
+    }
+
+    [[nodiscard]] constexpr std::string_view view() const noexcept
+    {
+        return {value, N - 1};
+    }
+};
+
+namespace detail {
+
+enum class static_template_segment_kind : uint8_t { text, placeholder };
+
+/** A piece of a static template.
+ *
+ * The offset and size refer to the template; for text this is the text to
+ * output, for a placeholder this is the format string, or empty for "{}".
+ */
+struct static_template_segment {
+    static_template_segment_kind kind = static_template_segment_kind::text;
+    std::size_t offset = 0;
+    std::size_t size = 0;
+
+    /** The index of the parameter of a placeholder.
+     */
+    std::size_t argument = 0;
+};
+
+[[nodiscard]] constexpr bool is_static_template_name_char(char c) noexcept
+{
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or c == '_';
+}
+
+[[nodiscard]] constexpr bool is_static_template_space(char c) noexcept
+{
+    return c == ' ' or c == '\t' or c == '\r' or c == '\n';
+}
+
+/** Parse a static template.
+ *
+ * The template starts in text-mode, like an included template. Placeholders
+ * are limited to a parameter name, `${"format", name}` and a string-literal
+ * without escape sequences.
+ *
+ * An error while evaluating this function at compile time is reported by the
+ * compiler at the `throw`.
+ *
+ * @param str The text of the template.
+ * @param names The names of the parameters.
+ * @param[out] segments When not null, the segments are written here.
+ * @return The number of segments.
+ * @throws csp_error On verbatim C++, directives, filters or an unknown parameter.
+ */
+template<std::size_t NumNames>
+[[nodiscard]] constexpr std::size_t parse_static_template(
+    std::string_view str,
+    std::array<std::string_view, NumNames> const& names,
+    static_template_segment *segments)
+{
+    auto num_segments = std::size_t{0};
+    auto const add = [&](static_template_segment segment) {
+        if (segments) {
+            segments[num_segments] = segment;
+        }
+        ++num_segments;
+    };
+
+    auto const skip_space = [&](std::size_t i) {
+        while (i != str.size() and is_static_template_space(str[i])) {
+            ++i;
+        }
+        return i;
+    };
+
+    // Returns the offset beyond the closing quote of a string-literal starting at i.
+    auto const skip_string_literal = [&](std::size_t i) {
+        for (++i; i != str.size(); ++i) {
+            if (str[i] == '\\') {
+                throw csp_error("Escape sequences in string-literals are not supported by a static template.");
+            } else if (str[i] == '"') {
+                return i + 1;
+            }
+        }
+        throw csp_error("Unexpected end of a static template parsing a string-literal.");
+    };
+
+    auto first = str.begin();
+    auto const last = str.end();
+    auto line_nr = 1;
+    while (first != last) {
+        auto const offset = static_cast<std::size_t>(first - str.begin());
+        auto after = parse_csp_after_text::text;
+        auto const token = parse_csp_text(first, last, line_nr, after);
+        if (not token.text.empty()) {
+            add({static_template_segment_kind::text, offset, token.text.size()});
+        }
+
+        if (after == parse_csp_after_text::text) {
+            // Escaped dollar.
+            continue;
+
+        } else if (after == parse_csp_after_text::verbatim) {
+            if (offset + token.text.size() != str.size()) {
+                throw csp_error("Verbatim C++ is not supported by a static template.");
+            }
+            continue;
+
+        } else if (after == parse_csp_after_text::line_verbatim) {
+            throw csp_error("Verbatim C++ is not supported by a static template.");
+        }
+
+        // Placeholder, the `${` was consumed.
+        auto i = skip_space(static_cast<std::size_t>(first - str.begin()));
+        if (i == str.size()) {
+            throw csp_error("Unexpected end of a static template parsing a placeholder.");
+        } else if (str[i] == '@') {
+            throw csp_error("Directives are not supported by a static template.");
+        } else if (str[i] == '`') {
+            throw csp_error("Filters are not supported by a static template.");
+        }
+
+        auto format_offset = std::size_t{0};
+        auto format_size = std::size_t{0};
+        if (str[i] == '"') {
+            auto const end = skip_string_literal(i);
+            format_offset = i + 1;
+            format_size = end - i - 2;
+            i = skip_space(end);
+
+            if (i != str.size() and str[i] == '}') {
+                // A string-literal is output as is.
+                if (format_size != 0) {
+                    add({static_template_segment_kind::text, format_offset, format_size});
+                }
+                first = str.begin() + i + 1;
+                continue;
+
+            } else if (i == str.size() or str[i] != ',') {
+                throw csp_error("Expecting ',' after the format string of a placeholder in a static template.");
+            }
+            i = skip_space(i + 1);
+        }
+
+        auto const name_offset = i;
+        while (i != str.size() and is_static_template_name_char(str[i])) {
+            ++i;
+        }
+        auto const name = str.substr(name_offset, i - name_offset);
+
+        i = skip_space(i);
+        if (i != str.size() and str[i] == '`') {
+            throw csp_error("Filters are not supported by a static template.");
+        } else if (i == str.size() or str[i] != '}' or name.empty()) {
+            throw csp_error("The argument of a placeholder in a static template must be a parameter name.");
+        }
+        first = str.begin() + i + 1;
+
+        auto const it = std::find(names.begin(), names.end(), name);
+        if (it == names.end()) {
+            throw csp_error("Unknown parameter in a static template.");
+        }
+        add({static_template_segment_kind::placeholder,
+             format_offset,
+             format_size,
+             static_cast<std::size_t>(it - names.begin())});
+    }
+
+    return num_segments;
+}
+
+} // namespace detail
+
+/** A template that is parsed at compile time.
+ *
+ * The template is a string-literal which starts in text-mode, like an included
+ * template. The names of the parameters follow the template, a placeholder
+ * outputs a parameter `${name}` or formats it `${"{:.2f}", name}`:
+ *
+ * ```cpp
+ * using greeting = csp::static_template<R"(Hello ${name}, you owe ${"{:.2f}", amount}.)", "name", "amount">;
+ *
+ * auto const str = greeting::render("World", 4.5);
+ * ```
+ *
+ * Each piece of text and placeholder becomes a separate function call,
+ * which the compiler can inline, without running hikocsp. Verbatim C++,
+ * directives and filters are not supported; errors are reported by the
+ * compiler.
+ *
+ * @tparam Str The text of the template.
+ * @tparam Names The names of the parameters, in the order they are passed to `render()`.
+ */
+template<fixed_string Str, fixed_string... Names>
+class static_template {
+public:
+    /** The number of characters of static text in the output.
+     */
+    [[nodiscard]] constexpr static std::size_t static_size() noexcept
+    {
+        auto r = std::size_t{0};
+        for (auto const& segment : segments) {
+            if (segment.kind == detail::static_template_segment_kind::text) {
+                r += segment.size;
+            }
+        }
+        return r;
+    }
+
+    /** Render the template by passing each piece of text to a callback.
+     *
+     * @param callback Called with a `std::string_view` or `std::string` for
+     *                 each piece of text, like the `--callback` option.
+     * @param args The values of the parameters.
+     */
+    template<typename Callback, typename... Args>
+        requires(sizeof...(Args) == sizeof...(Names))
+    static void render_to(Callback&& callback, Args const&...args)
+    {
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            (render_segment<I>(callback, args...), ...);
+        }(std::make_index_sequence<segments.size()>{});
+    }
+
+    /** Render the template into a string.
+     *
+     * @param args The values of the parameters.
+     * @return The output of the template.
+     */
+    template<typename... Args>
+        requires(sizeof...(Args) == sizeof...(Names))
+    [[nodiscard]] static std::string render(Args const&...args)
+    {
+        auto r = std::string{};
+        r.reserve(static_size());
+        render_to(
+            [&r](auto const& str) {
+                r += str;
+            },
+            args...);
+        return r;
+    }
+
+private:
+    constexpr static auto names = std::array<std::string_view, sizeof...(Names)>{Names.view()...};
+
+    constexpr static auto num_segments = detail::parse_static_template(Str.view(), names, nullptr);
+
+    constexpr static auto segments = [] {
+        auto r = std::array<detail::static_template_segment, num_segments>{};
+        [[maybe_unused]] auto const n = detail::parse_static_template(Str.view(), names, r.data());
+        return r;
+    }();
+
+    template<std::size_t I, typename Callback, typename... Args>
+    static void render_segment(Callback& callback, Args const&...args)
+    {
+        constexpr auto segment = segments[I];
+        constexpr auto str = Str.view().substr(segment.offset, segment.size);
+
+        if constexpr (segment.kind == detail::static_template_segment_kind::text) {
+            callback(str);
+
+        } else {
+            auto const& arg = std::get<segment.argument>(std::tie(args...));
+            using arg_type = std::remove_cvref_t<decltype(arg)>;
+
+            if constexpr (not str.empty()) {
+                callback(std::format(str, arg));
+            } else if constexpr (std::convertible_to<arg_type const&, std::string_view>) {
+                // Formatting a string with "{}" does not change it.
+                callback(std::string_view{arg});
+            } else {
+                callback(std::format("{}", arg));
+            }
+        }
+    }
+};
+
+}} // namespace csp::v1
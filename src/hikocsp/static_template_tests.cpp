@@ -0,0 +1,71 @@
+// Copyright Take Vos 2023.
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include "static_template.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace static_template_tests {
+
+std::size_t parse(std::string_view str)
+{
+    auto const names = std::array<std::string_view, 2>{"a", "b"};
+    return csp::detail::parse_static_template(str, names, nullptr);
+}
+
+} // namespace static_template_tests
+
+TEST(static_template, text)
+{
+    using page = csp::static_template<"<p>Hello World</p>\n">;
+
+    static_assert(page::static_size() == 19);
+    ASSERT_EQ(page::render(), "<p>Hello World</p>\n");
+}
+
+TEST(static_template, placeholder)
+{
+    using page = csp::static_template<R"(<td>${name}</td><td>${"{:.2f}", price}</td><td>${ count }</td>)", "name", "price", "count">;
+
+    ASSERT_EQ(page::render("foo", 1.5, 42), "<td>foo</td><td>1.50</td><td>42</td>");
+    ASSERT_EQ(page::render(std::string{"bar"}, 0.125, -1), "<td>bar</td><td>0.12</td><td>-1</td>");
+}
+
+TEST(static_template, escapes)
+{
+    using page = csp::static_template<R"(a$$b${"&amp;"}c)">;
+
+    ASSERT_EQ(page::render(), "a$b&amp;c");
+}
+
+TEST(static_template, render_to)
+{
+    using page = csp::static_template<"<b>${x}</b>", "x">;
+
+    auto pieces = std::vector<std::string>{};
+    page::render_to(
+        [&](auto const& str) {
+            pieces.emplace_back(str);
+        },
+        5);
+
+    ASSERT_EQ(pieces, (std::vector<std::string>{"<b>", "5", "</b>"}));
+}
+
+TEST(static_template, errors)
+{
+    ASSERT_EQ(static_template_tests::parse("x ${a} y ${b}"), 4);
+    ASSERT_EQ(static_template_tests::parse("${\"\"}"), 0);
+
+    ASSERT_THROW(static_template_tests::parse("x }}"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("x\n$for (;;) {\n"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("${c}"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("${a + 1}"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("${a`html}"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("${`html}"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("${@flush}"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("${\"\\n\"}"), csp::csp_error);
+    ASSERT_THROW(static_template_tests::parse("${a"), csp::csp_error);
+}